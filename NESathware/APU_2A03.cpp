@@ -1 +1,533 @@
 #include "APU_2A03.h"
+#include "BUS.h"
+#include <algorithm>
+
+//Source: "https://www.nesdev.org/wiki/APU_Length_Counter"
+static constexpr ubyte lengthTable[32u] =
+{
+	10, 254, 20, 2, 40, 4, 80, 6, 160, 8, 60, 10, 14, 12, 26, 14,
+	12, 16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+//Source: "https://www.nesdev.org/wiki/APU_Pulse"
+static constexpr ubyte dutySequences[4u][8u] =
+{
+	{ 0, 1, 0, 0, 0, 0, 0, 0 },//12.5%
+	{ 0, 1, 1, 0, 0, 0, 0, 0 },//25%
+	{ 0, 1, 1, 1, 1, 0, 0, 0 },//50%
+	{ 1, 0, 0, 1, 1, 1, 1, 1 } //25% negated
+};
+//Source: "https://www.nesdev.org/wiki/APU_Triangle"
+static constexpr ubyte triangleSequence[32u] =
+{
+	15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+	0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+};
+//NTSC periods in CPU cycles, Source: "https://www.nesdev.org/wiki/APU_Noise", "https://www.nesdev.org/wiki/APU_DMC"
+static constexpr ubyte2 noisePeriods[16u] = { 4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068 };
+static constexpr ubyte2 dmcPeriods[16u] = { 428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54 };
+//CPU cycles from the start of a frame counter sequence to each step, the last step ends the sequence
+static constexpr ubyte8 fourStepCycles[4u] = { 7457u, 14913u, 22371u, 29830u };
+static constexpr ubyte8 fiveStepCycles[5u] = { 7457u, 14913u, 22371u, 29829u, 37282u };
+
+APU_2A03::APU_2A03(BUS& bus, unsigned int sampleRate, BlipBuffer::Quality quality)
+	: Bus(bus), mFrameCounterNext(fourStepCycles[0]), mBlip(clockRate, sampleRate, sampleRate / 10u, quality)
+{
+	//Source: "https://www.nesdev.org/wiki/APU_Mixer#Lookup_Table"
+	mPulseTable[0] = 0.0f;
+	for (unsigned int n = 1; n < 31u; ++n)
+		mPulseTable[n] = 95.52f / (8128.0f / n + 100.0f);
+	mTNDTable[0] = 0.0f;
+	for (unsigned int n = 1; n < 203u; ++n)
+		mTNDTable[n] = 163.67f / (24329.0f / n + 100.0f);
+}
+
+void APU_2A03::Sync()
+{
+	RunUntil(Bus.mCPUCycle);
+
+	//Close the block so blip buffer times stay small, samples are only produced once a block ends
+	mBlip.EndBlock((ubyte4)(mSyncedCycle - mBlockStart));
+	mBlockStart = mSyncedCycle;
+}
+
+void APU_2A03::SyncDMC()
+{
+	//An idle DMC only starts through $4015, which catches up by itself
+	if (mDMC.BytesRemaining > 0)
+		RunUntil(Bus.mCPUCycle);
+}
+
+size_t APU_2A03::SamplesAvailable()
+{
+	Sync();
+	return mBlip.SamplesAvailable();
+}
+
+size_t APU_2A03::ReadSamples(float* out, size_t maxSamples)
+{
+	Sync();
+	return mBlip.ReadSamples(out, maxSamples);
+}
+
+void APU_2A03::SetRateAdjust(double ratio)
+{
+	//Deltas already added keep the old rate
+	Sync();
+	mBlip.SetRateAdjust(ratio);
+}
+
+//Move a channel timer to its next clock, a silent channel is moved past limit at once since its clocks change nothing that can be heard
+static void AdvanceTimer(ubyte8& nextClock, ubyte8 period, bool silent, ubyte8 limit)
+{
+	nextClock += period;
+	if (silent && nextClock < limit)
+		nextClock += (limit - nextClock + period - 1u) / period * period;
+}
+
+void APU_2A03::RunUntil(ubyte8 cycle)
+{
+	//Queued writes are in cycle order, everything before a write plays with the old register values
+	for (size_t i = 0; i < mQueuedWrites; ++i)
+	{
+		RunEvents(mWriteQueue[i].Cycle);
+		ApplyWrite(mWriteQueue[i]);
+	}
+	mQueuedWrites = 0;
+
+	RunEvents(cycle);
+	mSyncedCycle = std::max(mSyncedCycle, cycle);
+	Bus.SetIRQ(BUS::APU, IRQPending());
+}
+
+void APU_2A03::RunEvents(ubyte8 cycle)
+{
+	while (true)
+	{
+		const ubyte8 next = std::min({ mPulse1.NextClock, mPulse2.NextClock, mTriangle.NextClock, mNoise.NextClock, mDMC.NextClock, mFrameCounterNext });
+		if (next >= cycle)
+			break;
+
+		//Only register writes and frame counter steps can unmute a channel, and both end a run
+		const ubyte8 limit = std::min(cycle, mFrameCounterNext);
+		if (mPulse1.NextClock == next)
+		{
+			mPulse1.ClockTimer();
+			AdvanceTimer(mPulse1.NextClock, mPulse1.Period(), mPulse1.LengthCounter == 0 || mPulse1.TimerPeriod < 8u, limit);
+		}
+		if (mPulse2.NextClock == next)
+		{
+			mPulse2.ClockTimer();
+			AdvanceTimer(mPulse2.NextClock, mPulse2.Period(), mPulse2.LengthCounter == 0 || mPulse2.TimerPeriod < 8u, limit);
+		}
+		if (mTriangle.NextClock == next)
+		{
+			mTriangle.ClockTimer();
+			AdvanceTimer(mTriangle.NextClock, mTriangle.Period(), mTriangle.LengthCounter == 0 || mTriangle.LinearCounter == 0 || mTriangle.TimerPeriod < 2u, limit);
+		}
+		if (mNoise.NextClock == next)
+		{
+			mNoise.ClockTimer();
+			AdvanceTimer(mNoise.NextClock, mNoise.Period(), mNoise.LengthCounter == 0, limit);
+		}
+		if (mDMC.NextClock == next)
+		{
+			mDMC.ClockTimer();
+			FillDMCBuffer();
+			AdvanceTimer(mDMC.NextClock, mDMC.Period(), mDMC.Silence && mDMC.BufferEmpty && mDMC.BytesRemaining == 0, limit);
+		}
+		if (mFrameCounterNext == next)
+			ClockFrameCounter();
+
+		UpdateOutput(next);
+	}
+}
+
+void APU_2A03::UpdateOutput(ubyte8 cycle)
+{
+	const float output = mPulseTable[mPulse1.Output() + mPulse2.Output()] +
+		mTNDTable[3u * mTriangle.Output() + 2u * mNoise.Output() + mDMC.Output()];
+	if (output != mLastOutput)
+	{
+		mBlip.AddDelta((ubyte4)(cycle - mBlockStart), output - mLastOutput);
+		mLastOutput = output;
+	}
+}
+
+void APU_2A03::ClockFrameCounter()
+{
+	if (mFiveStepMode)
+	{
+		//Steps 0, 1, 2 and 4 are quarter frames, 1 and 4 are also half frames, step 3 does nothing
+		if (mFrameStep != 3u)
+			ClockQuarterFrame();
+		if (mFrameStep == 1u || mFrameStep == 4u)
+			ClockHalfFrame();
+	}
+	else
+	{
+		ClockQuarterFrame();
+		if (mFrameStep == 1u || mFrameStep == 3u)
+			ClockHalfFrame();
+		if (mFrameStep == 3u && !mIRQInhibit)
+			mFrameIRQ = true;
+	}
+
+	const ubyte8* stepCycles = mFiveStepMode ? fiveStepCycles : fourStepCycles;
+	const unsigned int numSteps = mFiveStepMode ? 5u : 4u;
+	if (++mFrameStep == numSteps)
+	{
+		mFrameCounterStart += stepCycles[numSteps - 1u];
+		mFrameStep = 0;
+	}
+	mFrameCounterNext = mFrameCounterStart + stepCycles[mFrameStep];
+}
+
+void APU_2A03::ClockQuarterFrame()
+{
+	mPulse1.Env.Clock();
+	mPulse2.Env.Clock();
+	mNoise.Env.Clock();
+	mTriangle.ClockLinearCounter();
+}
+
+void APU_2A03::ClockHalfFrame()
+{
+	mPulse1.ClockLengthAndSweep();
+	mPulse2.ClockLengthAndSweep();
+	mTriangle.ClockLength();
+	mNoise.ClockLength();
+}
+
+void APU_2A03::FillDMCBuffer()
+{
+	if (!mDMC.BufferEmpty || mDMC.BytesRemaining == 0)
+		return;
+
+	//The reader takes the bus from the CPU for 4 cycles, fewer when it lands on a write or next to OAM DMA, always 4 here
+	mDMC.SampleBuffer = Bus.ReadCPU(mDMC.CurrentAddress);
+	Bus.mpCPU->Stall(4);
+	mDMC.BufferEmpty = false;
+	mDMC.CurrentAddress = mDMC.CurrentAddress == 0xffffu ? 0x8000u : mDMC.CurrentAddress + 1u;
+	if (--mDMC.BytesRemaining == 0)
+	{
+		if (mDMC.Loop)
+			mDMC.Restart();
+		else if (mDMC.IRQEnabled)
+			mDMC.IRQFlag = true;
+	}
+}
+
+void APU_2A03::WriteRegister(ubyte val, ubyte2 address)
+{
+	//$4010, $4015 and $4017 can change the status and IRQs the CPU sees, they happen right away
+	if (address == 0x4010u || address == 0x4015u || address == 0x4017u)
+	{
+		RunUntil(Bus.mCPUCycle);
+		ApplyWrite({ Bus.mCPUCycle, address, val });
+		Bus.SetIRQ(BUS::APU, IRQPending());
+		return;
+	}
+
+	//Everything else only changes the sound, it waits for the next catch up
+	if (mQueuedWrites == mWriteQueue.size())
+		RunUntil(Bus.mCPUCycle);
+	mWriteQueue[mQueuedWrites++] = { Bus.mCPUCycle, address, val };
+}
+
+void APU_2A03::ApplyWrite(const RegisterWrite& write)
+{
+	const ubyte2 address = write.Address;
+	const ubyte val = write.Value;
+	if (address < 0x4004u)
+		mPulse1.Write(address & 0x03u, val);
+	else if (address < 0x4008u)
+		mPulse2.Write(address & 0x03u, val);
+	else if (address < 0x400cu)
+		mTriangle.Write(address & 0x03u, val);
+	else if (address < 0x4010u)
+		mNoise.Write(address & 0x03u, val);
+	else if (address < 0x4014u)
+	{
+		mDMC.Write(address & 0x03u, val);
+		if (address == 0x4010u && !mDMC.IRQEnabled)
+			mDMC.IRQFlag = false;
+	}
+	else if (address == 0x4015u)
+	{
+		mPulse1.Enabled = IsBitOn<0>(val);
+		mPulse2.Enabled = IsBitOn<1>(val);
+		mTriangle.Enabled = IsBitOn<2>(val);
+		mNoise.Enabled = IsBitOn<3>(val);
+		//Disabling a channel silences it through its length counter
+		if (!mPulse1.Enabled)
+			mPulse1.LengthCounter = 0;
+		if (!mPulse2.Enabled)
+			mPulse2.LengthCounter = 0;
+		if (!mTriangle.Enabled)
+			mTriangle.LengthCounter = 0;
+		if (!mNoise.Enabled)
+			mNoise.LengthCounter = 0;
+
+		mDMC.IRQFlag = false;
+		if (!IsBitOn<4>(val))
+			mDMC.BytesRemaining = 0;
+		else if (mDMC.BytesRemaining == 0)
+		{
+			mDMC.Restart();
+			FillDMCBuffer();
+		}
+	}
+	else if (address == 0x4017u)
+	{
+		mFiveStepMode = IsBitOn<7>(val);
+		mIRQInhibit = IsBitOn<6>(val);
+		if (mIRQInhibit)
+			mFrameIRQ = false;
+
+		//TODO: the reset is delayed by 3 - 4 CPU cycles on hardware
+		mFrameStep = 0;
+		mFrameCounterStart = write.Cycle;
+		mFrameCounterNext = mFrameCounterStart + (mFiveStepMode ? fiveStepCycles[0] : fourStepCycles[0]);
+		if (mFiveStepMode)
+		{
+			ClockQuarterFrame();
+			ClockHalfFrame();
+		}
+	}
+
+	UpdateOutput(write.Cycle);
+}
+
+ubyte APU_2A03::ReadStatus()
+{
+	RunUntil(Bus.mCPUCycle);
+
+	ubyte status = (mPulse1.LengthCounter > 0) |
+		((mPulse2.LengthCounter > 0) << 1u) |
+		((mTriangle.LengthCounter > 0) << 2u) |
+		((mNoise.LengthCounter > 0) << 3u) |
+		((mDMC.BytesRemaining > 0) << 4u) |
+		(mFrameIRQ << 6u) |
+		(mDMC.IRQFlag << 7u);
+	//Reading acknowledges the frame interrupt
+	mFrameIRQ = false;
+	Bus.SetIRQ(BUS::APU, IRQPending());
+	return status;
+}
+
+/* Envelope */
+
+void APU_2A03::Envelope::Clock()
+{
+	if (Start)
+	{
+		Start = false;
+		Decay = 15u;
+		Divider = Volume;
+		return;
+	}
+
+	if (Divider > 0)
+	{
+		--Divider;
+		return;
+	}
+	Divider = Volume;
+	if (Decay > 0)
+		--Decay;
+	else if (Loop)
+		Decay = 15u;
+}
+
+/* Pulse */
+
+void APU_2A03::Pulse::Write(ubyte reg, ubyte val)
+{
+	switch (reg)
+	{
+	case 0:
+		Duty = val >> 6u;
+		Env.Loop = IsBitOn<5>(val);
+		Env.ConstantVolume = IsBitOn<4>(val);
+		Env.Volume = val & 0x0fu;
+		break;
+	case 1:
+		SweepEnabled = IsBitOn<7>(val);
+		SweepPeriod = (val >> 4u) & 0x07u;
+		SweepNegate = IsBitOn<3>(val);
+		SweepShift = val & 0x07u;
+		SweepReload = true;
+		break;
+	case 2:
+		TimerPeriod = (TimerPeriod & 0x0700u) | val;
+		break;
+	case 3:
+		TimerPeriod = (TimerPeriod & 0x00ffu) | ((val & 0x07u) << 8u);
+		if (Enabled)
+			LengthCounter = lengthTable[val >> 3u];
+		//Restart the sequence and the envelope
+		DutyStep = 0;
+		Env.Start = true;
+		break;
+	}
+}
+
+ubyte2 APU_2A03::Pulse::SweepTarget() const
+{
+	const ubyte2 change = TimerPeriod >> SweepShift;
+	if (!SweepNegate)
+		return TimerPeriod + change;
+
+	const ubyte2 negated = change + (OnesComplementSweep ? 1u : 0u);
+	return negated > TimerPeriod ? 0 : TimerPeriod - negated;
+}
+
+void APU_2A03::Pulse::ClockLengthAndSweep()
+{
+	if (!Env.Loop && LengthCounter > 0)
+		--LengthCounter;
+
+	if (SweepDivider == 0 && SweepEnabled && SweepShift > 0 && TimerPeriod >= 8u && SweepTarget() <= 0x7ffu)
+		TimerPeriod = SweepTarget();
+	if (SweepDivider == 0 || SweepReload)
+	{
+		SweepDivider = SweepPeriod;
+		SweepReload = false;
+	}
+	else
+		--SweepDivider;
+}
+
+ubyte APU_2A03::Pulse::Output() const
+{
+	//Periods under 8 or sweeping past $7ff mute the channel even if the sweep unit is off
+	if (LengthCounter == 0 || TimerPeriod < 8u || SweepTarget() > 0x7ffu || dutySequences[Duty][DutyStep] == 0)
+		return 0;
+	return Env.Output();
+}
+
+/* Triangle */
+
+void APU_2A03::Triangle::Write(ubyte reg, ubyte val)
+{
+	switch (reg)
+	{
+	case 0:
+		Control = IsBitOn<7>(val);
+		LinearReloadValue = val & 0x7fu;
+		break;
+	case 2:
+		TimerPeriod = (TimerPeriod & 0x0700u) | val;
+		break;
+	case 3:
+		TimerPeriod = (TimerPeriod & 0x00ffu) | ((val & 0x07u) << 8u);
+		if (Enabled)
+			LengthCounter = lengthTable[val >> 3u];
+		LinearReload = true;
+		break;
+	}
+}
+
+void APU_2A03::Triangle::ClockTimer()
+{
+	//Periods under 2 are ultrasonic, games use them to silence the channel so hold the step instead of popping
+	if (LengthCounter > 0 && LinearCounter > 0 && TimerPeriod >= 2u)
+		Step = (Step + 1u) & 0x1fu;
+}
+
+void APU_2A03::Triangle::ClockLinearCounter()
+{
+	if (LinearReload)
+		LinearCounter = LinearReloadValue;
+	else if (LinearCounter > 0)
+		--LinearCounter;
+
+	if (!Control)
+		LinearReload = false;
+}
+
+ubyte APU_2A03::Triangle::Output() const
+{
+	//The triangle keeps outputting its current step when it is halted
+	return triangleSequence[Step];
+}
+
+/* Noise */
+
+void APU_2A03::Noise::Write(ubyte reg, ubyte val)
+{
+	switch (reg)
+	{
+	case 0:
+		Env.Loop = IsBitOn<5>(val);
+		Env.ConstantVolume = IsBitOn<4>(val);
+		Env.Volume = val & 0x0fu;
+		break;
+	case 2:
+		Mode = IsBitOn<7>(val);
+		TimerPeriod = noisePeriods[val & 0x0fu];
+		break;
+	case 3:
+		if (Enabled)
+			LengthCounter = lengthTable[val >> 3u];
+		Env.Start = true;
+		break;
+	}
+}
+
+void APU_2A03::Noise::ClockTimer()
+{
+	//Feedback from bit 0 and bit 1, or bit 6 in short mode
+	const ubyte2 feedback = (ShiftRegister ^ (ShiftRegister >> (Mode ? 6u : 1u))) & 0x01u;
+	ShiftRegister = (ShiftRegister >> 1u) | (feedback << 14u);
+}
+
+/* DMC */
+
+void APU_2A03::DMC::Write(ubyte reg, ubyte val)
+{
+	switch (reg)
+	{
+	case 0:
+		IRQEnabled = IsBitOn<7>(val);
+		Loop = IsBitOn<6>(val);
+		TimerPeriod = dmcPeriods[val & 0x0fu];
+		break;
+	case 1:
+		Level = val & 0x7fu;
+		break;
+	case 2:
+		SampleAddress = 0xc000u + val * 64u;
+		break;
+	case 3:
+		SampleLength = val * 16u + 1u;
+		break;
+	}
+}
+
+void APU_2A03::DMC::ClockTimer()
+{
+	if (!Silence)
+	{
+		//Move the level up or down by 2 for every bit, clamped to 0 - 127
+		if (IsBitOn<0>(ShiftRegister))
+		{
+			if (Level <= 125u)
+				Level += 2u;
+		}
+		else if (Level >= 2u)
+			Level -= 2u;
+	}
+	ShiftRegister >>= 1u;
+
+	if (--BitsRemaining == 0)
+	{
+		BitsRemaining = 8u;
+		Silence = BufferEmpty;
+		if (!BufferEmpty)
+		{
+			ShiftRegister = SampleBuffer;
+			BufferEmpty = true;
+		}
+	}
+}
@@ -1,13 +1,250 @@
 #pragma once
+#include "CommonTypes.h"
+#include "BlipBuffer.h"
+#include <array>
+#include <algorithm>
+
+//NES Audio Processing Unit, Source: "https://www.nesdev.org/wiki/APU"
+//Like the PPU, the APU only runs when it has to: on status access, frame counter steps, DMC fetches and when samples are read
+//Channels then advance a whole timer period at a time and every change in the mixed output goes into a BlipBuffer
 class APU_2A03
 {
 public:
-	APU_2A03(class BUS& bus)
-		: bus(bus)
-	{}
+	APU_2A03(class BUS& bus, unsigned int sampleRate = 44100u, BlipBuffer::Quality quality = BlipBuffer::Quality::Normal);
+
+	//Catch the APU up to the current CPU cycle
+	void Sync();
+	//Catch up before a cartridge write while the DMC can still read PRG ROM, so its past fetches see the old banks
+	void SyncDMC();
+	//CPU cycle of the next frame counter step or DMC sample fetch, or of the next DMC clock while a DMC IRQ can come from it
+	//Fetches read PRG ROM and stall the CPU, so they have to happen on their own cycle and not after a later bank switch
+	ubyte8 NextEventCycle() const
+	{
+		const ubyte8 next = mDMC.BytesRemaining > 0 ? std::min(mFrameCounterNext, mDMC.NextFetchCycle()) : mFrameCounterNext;
+		const bool dmcIRQArmed = mDMC.IRQEnabled && !mDMC.Loop && mDMC.BytesRemaining > 0;
+		return dmcIRQArmed ? std::min(next, mDMC.NextClock) : next;
+	}
+	//$4000 - $4013, $4015 and $4017
+	void WriteRegister(ubyte val, ubyte2 address);
+	//$4015
+	ubyte ReadStatus();
+	//A frame counter or DMC interrupt is waiting to be acknowledged
+	bool IRQPending() const
+	{
+		return mFrameIRQ || mDMC.IRQFlag;
+	}
+
+	//Samples emulated up to the current CPU cycle
+	size_t SamplesAvailable();
+	//Read up to maxSamples mono samples, returns the number read
+	size_t ReadSamples(float* out, size_t maxSamples);
+	//Fine tune the output sample rate, see BlipBuffer::SetRateAdjust
+	void SetRateAdjust(double ratio);
+
+	//NTSC CPU clock
+	static constexpr double clockRate = 1789773.0;
 private:
-	BUS& bus;
+	BUS& Bus;
 
+	//Source: "https://www.nesdev.org/wiki/APU_Envelope"
+	struct Envelope
+	{
+		bool Start = false;
+		bool Loop = false;
+		bool ConstantVolume = false;
+		//Constant volume, or the divider period
+		ubyte Volume = 0;
+		ubyte Divider = 0;
+		ubyte Decay = 0;
 
-};
+		void Clock();
+		ubyte Output() const
+		{
+			return ConstantVolume ? Volume : Decay;
+		}
+	};
+
+	//Source: "https://www.nesdev.org/wiki/APU_Pulse", "https://www.nesdev.org/wiki/APU_Sweep"
+	struct Pulse
+	{
+		//Pulse 1 negates its sweep with one's complement, pulse 2 with two's complement
+		bool OnesComplementSweep;
+		bool Enabled = false;
+		ubyte Duty = 0;
+		ubyte DutyStep = 0;
+		ubyte2 TimerPeriod = 0;
+		ubyte LengthCounter = 0;
+		Envelope Env;
+		bool SweepEnabled = false;
+		bool SweepNegate = false;
+		bool SweepReload = false;
+		ubyte SweepPeriod = 0;
+		ubyte SweepShift = 0;
+		ubyte SweepDivider = 0;
+		ubyte8 NextClock = 0;
+
+		void Write(ubyte reg, ubyte val);
+		//Pulse timers count APU cycles, 2 CPU cycles each
+		ubyte8 Period() const
+		{
+			return (TimerPeriod + 1u) * 2u;
+		}
+		ubyte2 SweepTarget() const;
+		void ClockTimer()
+		{
+			DutyStep = (DutyStep + 1u) & 0x07u;
+		}
+		void ClockLengthAndSweep();
+		ubyte Output() const;
+	};
+
+	//Source: "https://www.nesdev.org/wiki/APU_Triangle"
+	struct Triangle
+	{
+		bool Enabled = false;
+		ubyte2 TimerPeriod = 0;
+		ubyte Step = 0;
+		ubyte LengthCounter = 0;
+		//Also the length counter halt flag
+		bool Control = false;
+		bool LinearReload = false;
+		ubyte LinearReloadValue = 0;
+		ubyte LinearCounter = 0;
+		ubyte8 NextClock = 0;
+
+		void Write(ubyte reg, ubyte val);
+		ubyte8 Period() const
+		{
+			return TimerPeriod + 1u;
+		}
+		void ClockTimer();
+		void ClockLinearCounter();
+		void ClockLength()
+		{
+			if (!Control && LengthCounter > 0)
+				--LengthCounter;
+		}
+		ubyte Output() const;
+	};
+
+	//Source: "https://www.nesdev.org/wiki/APU_Noise"
+	struct Noise
+	{
+		bool Enabled = false;
+		bool Mode = false;
+		ubyte2 TimerPeriod = 4u;
+		ubyte2 ShiftRegister = 1u;
+		ubyte LengthCounter = 0;
+		Envelope Env;
+		ubyte8 NextClock = 0;
 
+		void Write(ubyte reg, ubyte val);
+		ubyte8 Period() const
+		{
+			return TimerPeriod;
+		}
+		void ClockTimer();
+		void ClockLength()
+		{
+			if (!Env.Loop && LengthCounter > 0)
+				--LengthCounter;
+		}
+		ubyte Output() const
+		{
+			return (ShiftRegister & 0x01u) || LengthCounter == 0 ? 0 : Env.Output();
+		}
+	};
+
+	//Source: "https://www.nesdev.org/wiki/APU_DMC"
+	struct DMC
+	{
+		bool IRQEnabled = false;
+		bool IRQFlag = false;
+		bool Loop = false;
+		ubyte2 TimerPeriod = 428u;
+		ubyte Level = 0;
+		ubyte2 SampleAddress = 0xc000u;
+		ubyte2 SampleLength = 1u;
+		ubyte2 CurrentAddress = 0xc000u;
+		ubyte2 BytesRemaining = 0;
+		ubyte SampleBuffer = 0;
+		bool BufferEmpty = true;
+		ubyte ShiftRegister = 0;
+		ubyte BitsRemaining = 8u;
+		bool Silence = true;
+		ubyte8 NextClock = 0;
+
+		void Write(ubyte reg, ubyte val);
+		ubyte8 Period() const
+		{
+			return TimerPeriod;
+		}
+		void Restart()
+		{
+			CurrentAddress = SampleAddress;
+			BytesRemaining = SampleLength;
+		}
+		//The memory reader refills SampleBuffer afterwards, see FillDMCBuffer
+		void ClockTimer();
+		//CPU cycle of the clock that empties SampleBuffer, the memory reader refills it right then
+		ubyte8 NextFetchCycle() const
+		{
+			return BufferEmpty ? NextClock : NextClock + (BitsRemaining - 1u) * Period();
+		}
+		ubyte Output() const
+		{
+			return Level;
+		}
+	};
+
+	//A register write waiting to be applied at its CPU cycle
+	struct RegisterWrite
+	{
+		ubyte8 Cycle;
+		ubyte2 Address;
+		ubyte Value;
+	};
+
+	//Apply the queued writes and run everything up to cycle
+	void RunUntil(ubyte8 cycle);
+	//Run every channel and the frame counter up to cycle, in time order so the mixer sees every change where it happens
+	void RunEvents(ubyte8 cycle);
+	void ApplyWrite(const RegisterWrite& write);
+	void ClockFrameCounter();
+	void ClockQuarterFrame();
+	void ClockHalfFrame();
+	//Fetch the next DMC sample byte if the DMC buffer is empty, Source: "https://www.nesdev.org/wiki/APU_DMC#Memory_reader"
+	void FillDMCBuffer();
+	//Mix the channels and add the change in output at cycle to the blip buffer
+	void UpdateOutput(ubyte8 cycle);
+
+	Pulse mPulse1{ true };
+	Pulse mPulse2{ false };
+	Triangle mTriangle;
+	Noise mNoise;
+	DMC mDMC;
+
+	//Sound register writes since the last catch up, so writing a register from the CPU loop only costs a store
+	//Status reads, IRQ affecting writes, frame counter steps and bank switches during DMC playback catch up, and so does reading samples once per frame
+	std::array<RegisterWrite, 1024u> mWriteQueue;
+	size_t mQueuedWrites = 0;
+
+	/* Frame counter, Source: "https://www.nesdev.org/wiki/APU_Frame_Counter" */
+	bool mFiveStepMode = false;
+	bool mIRQInhibit = false;
+	bool mFrameIRQ = false;
+	unsigned int mFrameStep = 0;
+	//CPU cycle the current frame counter sequence started on, and of its next step
+	ubyte8 mFrameCounterStart = 0;
+	ubyte8 mFrameCounterNext = 0;
+
+	/* Output */
+	//Cycle everything has been emulated up to, and the cycle the current blip buffer block starts on
+	ubyte8 mSyncedCycle = 0;
+	ubyte8 mBlockStart = 0;
+	BlipBuffer mBlip;
+	float mLastOutput = 0.0f;
+	//Nonlinear mixer as lookup tables, Source: "https://www.nesdev.org/wiki/APU_Mixer#Lookup_Table"
+	float mPulseTable[31u];
+	float mTNDTable[203u];
+};
@@ -2,6 +2,10 @@
 
 ubyte BUS::ReadCPU(ubyte2 address)
 {
+	//PRG ROM first, every opcode fetch lands there
+	if (address >= 0x8000u)
+		return mpCartridge->ReadCPU(address);
+
 	if (address < 0x2000u)
 	{
 		//2KB internal RAM and mirrors
@@ -17,7 +21,11 @@ ubyte BUS::ReadCPU(ubyte2 address)
 	{
 		//APU and I/O registers
 		if (address == 0x4016u || address == 0x4017u)
-			return mpController->ReadCPU();
+			return mpController->ReadCPU(address & 0x01u);
+		if (address == 0x4015u)
+			return mpAPU->ReadStatus();
+		//The rest are write only
+		return 0;
 	}
 	else if (address < 0x4020u)
 	{
@@ -48,31 +56,12 @@ void BUS::WriteCPU(ubyte val, ubyte2 address)
 	else if (address < 0x4018u)
 	{
 		//APU and I/O registers
-		if (address < 0x4004u)
-		{
-			// Square 1
-		}
-		if (address < 0x4008u)
-		{
-			// Square 2
-		}
-		if (address < 0x400cu)
-		{
-			// Triangle
-		}
-		if (address < 0x4010u)
-		{
-			// Noise
-		}
-		if (address < 0x4014u)
-		{
-			// DMC
-		}
-		
 		if (address == 0x4014u)
 			mpPPU->WriteOAMDMA(&mRAM[(unsigned int)val << 8u]);
 		else if (address == 0x4016u)
 			mpController->WriteCPU(val);
+		else
+			mpAPU->WriteRegister(val, address);//Pulse 1 and 2, triangle, noise, DMC, $4015 and the $4017 frame counter
 	}
 	else if (address < 0x4020u)
 	{
@@ -81,8 +70,47 @@ void BUS::WriteCPU(ubyte val, ubyte2 address)
 	}
 	else if (address <= 0xffffu)
 	{
-		//Cartridge space
+		//Cartridge space, bank switches have to happen between the PPU's and the DMC's past and future reads
+		if (address < 0x8000u)
+		{
+			//PRG RAM
+			mpCartridge->WriteCPU(val, address);
+			return;
+		}
+		mpPPU->Sync();
+		mpAPU->SyncDMC();
 		mpCartridge->WriteCPU(val, address);
+		SetIRQ(Cartridge, mpCartridge->IRQPending());
+		if (mpCartridge->GetMirroring() != mMirroring)
+			SetMirroring(mpCartridge->GetMirroring());
+		if (const ubyte changedWindows = mpCartridge->TakeCHRBankChanges())
+			mpPPU->PatternWindowsChanged(changedWindows);
+	}
+}
+
+void BUS::SetMirroring(Mirroring mirroring)
+{
+	mMirroring = mirroring;
+	switch (mirroring)
+	{
+	case Mirroring::Vertical:
+		//Horizontal arrangement
+		Mirror = [](ubyte2 address) {return address % 0x800u; };
+		mpPPU->nextNametableOffset = 0x400u;
+		break;
+	case Mirroring::Horizontal:
+		//Vertical Arrrangement
+		Mirror = [](ubyte2 address) { return 0x400 * (address >= 0x2800u) + address % 0x400u; };
+		mpPPU->nextNametableOffset = 0x800u;
+		break;
+	case Mirroring::SingleScreenLower:
+		Mirror = [](ubyte2 address) { return address % 0x400u; };
+		mpPPU->nextNametableOffset = 0x400u;
+		break;
+	case Mirroring::SingleScreenUpper:
+		Mirror = [](ubyte2 address) { return 0x400u + address % 0x400u; };
+		mpPPU->nextNametableOffset = 0x400u;
+		break;
 	}
 }
 
@@ -22,13 +22,36 @@ public:
 	{
 		mpCPU->NMI();
 	}
+	//Devices that can hold the CPU's IRQ line, the line is asserted while any of them holds it
+	enum IRQSource : ubyte
+	{
+		APU = 0x01u,
+		Cartridge = 0x02u
+	};
+	void SetIRQ(IRQSource source, bool asserted)
+	{
+		mIRQLine = asserted ? (mIRQLine | source) : (mIRQLine & ~source);
+	}
+	//PPU address line A12 went from low to high, cartridge scanline counters count these
+	void A12Rise()
+	{
+		mpCartridge->ClockScanline();
+		SetIRQ(Cartridge, mpCartridge->IRQPending());
+	}
+	//Point Mirror and the PPU's next nametable offset at the cartridge's nametable arrangement, the renderer picks it up from the next frame
+	void SetMirroring(Mirroring mirroring);
 public:
 	Mapper* mpCartridge = nullptr;
 	CPU_6052* mpCPU = nullptr;
 	PPU_2C02* mpPPU = nullptr;
 	APU_2A03* mpAPU = nullptr;
 	Controller* mpController = nullptr;
+	//CPU cycles elapsed since power on, the PPU uses it to catch up lazily
+	ubyte8 mCPUCycle = 0;
+	//IRQSource bits, polled by the CPU between instructions
+	ubyte mIRQLine = 0;
 	std::function<ubyte2(ubyte2)> Mirror;
+	Mirroring mMirroring = Mirroring::Horizontal;
 	//2KB onboard ram and rest of address space
 	std::array<ubyte, 0x0800u> mRAM = { 0 };
 	//2KB onboard VRAM
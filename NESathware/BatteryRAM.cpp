@@ -0,0 +1,41 @@
+#include "BatteryRAM.h"
+
+BatteryRAM::BatteryRAM(const std::filesystem::path& file, size_t size, std::chrono::milliseconds flushInterval)
+	: mFlushInterval(flushInterval)
+{
+	try
+	{
+		mpFile = std::make_unique<MappedFile>(file, size);
+	}
+	//Another console owns the save, or it can't be written, play on a copy of it
+	catch (const Exception&)
+	{
+		mpFile = std::make_unique<MappedFile>(file, size, MappedFile::Writes::PrivateCopy);
+		mSaved = false;
+	}
+	if (mSaved)
+		mFlusher = std::thread(&BatteryRAM::FlushThread, this);
+}
+
+BatteryRAM::~BatteryRAM()
+{
+	{
+		std::lock_guard<std::mutex> lock(mStopMutex);
+		mStop = true;
+	}
+	mStopSignal.notify_one();
+	if (mFlusher.joinable())
+		mFlusher.join();
+	mpFile->Flush();
+}
+
+void BatteryRAM::FlushThread()
+{
+	std::unique_lock<std::mutex> lock(mStopMutex);
+	while (!mStopSignal.wait_for(lock, mFlushInterval, [this] { return mStop; }))
+	{
+		//Most games only write their save RAM now and then, don't touch the disk in between
+		if (mDirty.exchange(false, std::memory_order_relaxed))
+			mpFile->Flush();
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "CommonTypes.h"
+#include "../SathwareEngine/MappedFile.h"
+#include <filesystem>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+//Battery backed cartridge RAM kept in a memory mapped save file
+//The game writes straight into the mapping and never waits on the disk, a background thread writes modified pages back to the disk every flushInterval
+//A crash of the emulator loses nothing since the pages belong to the OS, a crash of the OS loses at most flushInterval of saving
+//Only one console at a time owns a save file, any other console running with it gets a private copy of it that is never saved
+class BatteryRAM
+{
+public:
+	//The file is created, or grown to size bytes, if it is too small
+	//Throws Exception if the file can't be opened for writing and there is no existing save to copy, e.g. in a read only folder
+	BatteryRAM(const std::filesystem::path& file, size_t size, std::chrono::milliseconds flushInterval = std::chrono::milliseconds(2000));
+	//Stops the flush thread and flushes one last time
+	~BatteryRAM();
+
+	ubyte* GetData()
+	{
+		return mpFile->GetWritableData();
+	}
+	size_t GetSize() const
+	{
+		return mpFile->GetSize();
+	}
+	//false for a private copy of a save another console owns
+	bool IsSaved() const
+	{
+		return mSaved;
+	}
+	//Emulation thread, after writing to the RAM
+	void MarkDirty()
+	{
+		mDirty.store(true, std::memory_order_relaxed);
+	}
+
+	BatteryRAM(const BatteryRAM& other) = delete;
+	BatteryRAM(const BatteryRAM&& other) = delete;
+	BatteryRAM& operator=(const BatteryRAM& other) = delete;
+private:
+	void FlushThread();
+
+	std::unique_ptr<MappedFile> mpFile;
+	bool mSaved = true;
+	std::chrono::milliseconds mFlushInterval;
+	std::atomic<bool> mDirty = false;
+
+	std::thread mFlusher;
+	//Wakes the flush thread early when shutting down
+	std::mutex mStopMutex;
+	std::condition_variable mStopSignal;
+	bool mStop = false;
+};
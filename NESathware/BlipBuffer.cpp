@@ -0,0 +1,114 @@
+#include "BlipBuffer.h"
+#include <cmath>
+#include <cstring>
+#include <numbers>
+#include <algorithm>
+
+//Taps, phase bits and cutoff for every Quality, shorter kernels need a lower cutoff to keep their wider transition band under nyquist
+struct KernelSetup
+{
+	unsigned int Taps;
+	unsigned int PhaseBits;
+	double Cutoff;
+};
+static constexpr KernelSetup kernelSetups[3u] =
+{
+	{ 8u, 5u, 0.40 },
+	{ 16u, 6u, 0.45 },
+	{ 32u, 8u, 0.47 }
+};
+
+BlipBuffer::BlipBuffer(double clockRate, unsigned int sampleRate, size_t capacity, Quality quality)
+	: mPhaseBits(kernelSetups[(unsigned int)quality].PhaseBits), mTapGroups(kernelSetups[(unsigned int)quality].Taps / 4u),
+	mKernels(std::make_unique<__m128[]>((size_t(1u) << mPhaseBits) * mTapGroups)),
+	mDeltas(capacity + mTapGroups * 4u + 1u, 0.0f), mCapacity(capacity),
+	mBaseFactor(sampleRate / clockRate * double(1ull << fractionBits)), mFactor((ubyte8)(mBaseFactor + 0.5))
+{
+	const unsigned int kernelTaps = mTapGroups * 4u;
+	const unsigned int numPhases = 1u << mPhaseBits;
+	const double cutoff = kernelSetups[(unsigned int)quality].Cutoff;
+	constexpr double pi = std::numbers::pi;
+	std::vector<double> kernel(kernelTaps);
+	for (unsigned int phase = 0; phase < numPhases; ++phase)
+	{
+		double sum = 0.0;
+		for (unsigned int tap = 0; tap < kernelTaps; ++tap)
+		{
+			//Distance in samples from the center of the impulse, the step happens phase / numPhases into a sample
+			const double x = tap - (kernelTaps / 2.0) + 1.0 - double(phase) / numPhases;
+			const double sinc = x == 0.0 ? 1.0 : std::sin(2.0 * pi * cutoff * x) / (2.0 * pi * cutoff * x);
+			//Blackman window, Source: "https://en.wikipedia.org/wiki/Window_function#Blackman_window"
+			const double window = 0.42 + 0.5 * std::cos(2.0 * pi * x / kernelTaps) + 0.08 * std::cos(4.0 * pi * x / kernelTaps);
+			kernel[tap] = sinc * window;
+			sum += kernel[tap];
+		}
+		//A step has to end up exactly delta higher no matter where it lands
+		__m128* phaseKernel = &mKernels[phase * mTapGroups];
+		for (unsigned int group = 0; group < mTapGroups; ++group)
+		{
+			const double* taps = &kernel[group * 4u];
+			phaseKernel[group] = _mm_setr_ps(float(taps[0] / sum), float(taps[1] / sum), float(taps[2] / sum), float(taps[3] / sum));
+		}
+	}
+
+	//About 90Hz, like the high pass filter in the NES output, Source: "https://www.nesdev.org/wiki/APU_Mixer"
+	mDCCoefficient = float(1.0 - std::exp(-2.0 * pi * 90.0 / sampleRate));
+}
+
+void BlipBuffer::AddDelta(ubyte4 clockTime, float delta)
+{
+	const ubyte8 position = mOffset + clockTime * mFactor;
+	size_t index = (size_t)(position >> fractionBits);
+	const unsigned int phase = (unsigned int)(position >> (fractionBits - mPhaseBits)) & ((1u << mPhaseBits) - 1u);
+	if (index + mTapGroups * 4u > mDeltas.size())
+	{
+		//Nobody has read for longer than the buffer holds, drop the oldest finished samples like EndBlock does
+		//A lost delta would shift the waveform for good, so a block too long to fit even then grows the buffer
+		index -= ReadSamples(nullptr, std::min(index + mTapGroups * 4u - mDeltas.size(), SamplesAvailable()));
+		if (index + mTapGroups * 4u > mDeltas.size())
+			mDeltas.resize(index + mTapGroups * 4u, 0.0f);
+	}
+
+	mDeltasEnd = std::max(mDeltasEnd, index + mTapGroups * 4u);
+	const __m128* kernel = &mKernels[phase * mTapGroups];
+	const __m128 scale = _mm_set1_ps(delta);
+	float* deltas = &mDeltas[index];
+	for (unsigned int group = 0; group < mTapGroups; ++group, deltas += 4)
+		_mm_storeu_ps(deltas, _mm_add_ps(_mm_loadu_ps(deltas), _mm_mul_ps(scale, kernel[group])));
+}
+
+void BlipBuffer::SetRateAdjust(double ratio)
+{
+	mRateAdjust = ratio;
+	mFactor = (ubyte8)(mBaseFactor * ratio + 0.5);
+}
+
+void BlipBuffer::EndBlock(ubyte4 clocks)
+{
+	mOffset += clocks * mFactor;
+
+	//Nobody is reading, keep only the newest samples
+	if (SamplesAvailable() > mCapacity)
+		ReadSamples(nullptr, SamplesAvailable() - mCapacity);
+}
+
+size_t BlipBuffer::ReadSamples(float* out, size_t maxSamples)
+{
+	const size_t count = std::min(maxSamples, SamplesAvailable());
+	for (size_t i = 0; i < count; ++i)
+	{
+		mIntegrator += mDeltas[i];
+		mDCLevel += (mIntegrator - mDCLevel) * mDCCoefficient;
+		if (out != nullptr)
+			out[i] = mIntegrator - mDCLevel;
+	}
+
+	//Deltas past the read samples, including kernel tails reaching into the next block, move to the front
+	//Everything past the end of the last kernel added is still zero
+	const size_t used = std::max(mDeltasEnd, count);
+	memmove(mDeltas.data(), mDeltas.data() + count, (used - count) * sizeof(float));
+	std::fill(mDeltas.begin() + (used - count), mDeltas.begin() + used, 0.0f);
+	mDeltasEnd = used - count;
+	mOffset -= (ubyte8)count << fractionBits;
+	return count;
+}
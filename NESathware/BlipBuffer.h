@@ -0,0 +1,66 @@
+#pragma once
+#include "CommonTypes.h"
+#include <vector>
+#include <memory>
+#include <xmmintrin.h>
+
+//Band-limited step synthesis, turns amplitude changes at clock times into samples without aliasing
+//Every change adds a band-limited step (stored as its derivative, a windowed sinc impulse) at its exact sub-sample position,
+//reading integrates those impulses back into a waveform, Source: "http://slack.net/~ant/bl-synth/"
+//The impulse is a polyphase filter bank: one kernel per sub-sample phase, so resampling from the clock rate is free and the ratio can change at any block
+class BlipBuffer
+{
+public:
+	//Kernel length against throughput, every level doubles the taps per delta
+	enum class Quality
+	{
+		Fast,//8 taps, 32 phases
+		Normal,//16 taps, 64 phases
+		High//32 taps, 256 phases
+	};
+
+	//capacity is how many unread samples are kept, older samples are thrown away once it is exceeded
+	BlipBuffer(double clockRate, unsigned int sampleRate, size_t capacity, Quality quality = Quality::Normal);
+
+	//Amplitude changes by delta at clockTime clocks after the start of the current block
+	void AddDelta(ubyte4 clockTime, float delta);
+	//Finish the current block after clocks clocks, the samples it covers become readable
+	void EndBlock(ubyte4 clocks);
+
+	//Scale the number of samples made per clock by ratio, e.g. 1.005 makes 0.5% more samples, takes effect from the current block
+	void SetRateAdjust(double ratio);
+	double GetRateAdjust() const
+	{
+		return mRateAdjust;
+	}
+
+	size_t SamplesAvailable() const
+	{
+		return (size_t)(mOffset >> fractionBits);
+	}
+	//Read up to maxSamples finished samples with DC removed, returns the number read, out may be nullptr to drop them
+	size_t ReadSamples(float* out, size_t maxSamples);
+private:
+	//Sample positions are 32.32 fixed point
+	static constexpr unsigned int fractionBits = 32u;
+
+	unsigned int mPhaseBits;
+	//Kernel taps in groups of 4
+	unsigned int mTapGroups;
+	//Impulse of a step at each of the 1 << mPhaseBits sub-sample positions, every kernel sums to 1
+	std::unique_ptr<__m128[]> mKernels;
+	std::vector<float> mDeltas;
+	//One past the last delta that can be non-zero
+	size_t mDeltasEnd = 0;
+	size_t mCapacity;
+	//Samples per clock without and with the rate adjustment, and the position of the start of the current block, in 32.32 fixed point
+	double mBaseFactor;
+	double mRateAdjust = 1.0;
+	ubyte8 mFactor;
+	ubyte8 mOffset = 0;
+
+	//Running sum of the deltas, and a slow moving average of it that is removed as DC
+	float mIntegrator = 0.0f;
+	float mDCLevel = 0.0f;
+	float mDCCoefficient;
+};
@@ -15,6 +15,16 @@ void CPU_6052::Execute()
 		return;
 	}
 
+	//The IRQ line is level triggered and polled between instructions, while nothing holds it this is the only cost
+	if (Bus.mIRQLine != 0) [[unlikely]]
+	{
+		if (!IsSet(InterruptDisable))
+		{
+			IRQ();
+			return;
+		}
+	}
+
 	//ubyte2 currAddress = ProgramCounter;
 	//if (currAddress == 0xf21cu/*0xf1ecu*/)
 		//int x = 5;
@@ -65,7 +75,9 @@ void CPU_6052::IRQ()
 	{
 		PushOntoStack(HighByte(ProgramCounter));
 		PushOntoStack(LowByte(ProgramCounter));
-		PushOntoStack(Status | Break | InterruptDisable);
+		//Unlike BRK the pushed Break flag is clear, and the handler runs with interrupts disabled so a held line doesn't interrupt it again
+		PushOntoStack((Status | Reserved) & ~Break);
+		SetFlag(InterruptDisable);
 		//address of IRQ interrupt handler
 		ubyte2 pInterruptHandlerLow = Read(0xfffe);
 		ubyte2 pInterruptHandlerHigh = Read(0xffff);
@@ -30,6 +30,12 @@ public:
 	//Interrupt function for simulating Interrupts and non maskable interrupts as per specification
 	void NMI();
 	void IRQ();
+
+	//Hold the CPU off the bus for a number of cycles, for DMA reads that take it away
+	void Stall(int cycles)
+	{
+		mWaitCycles += cycles;
+	}
 private:
 	//THIS CPU IS LITTLE ENDIAN
 
@@ -7,6 +7,8 @@ typedef __int16 sbyte2;
 
 typedef unsigned __int8 ubyte;
 typedef unsigned __int16 ubyte2;
+typedef unsigned __int32 ubyte4;
+typedef unsigned __int64 ubyte8;
 
 template<ubyte bit>
 static bool IsBitOn(const ubyte2 data)
@@ -1,37 +1,30 @@
 #include "Controller.h"
 #include "BUS.h"
-#include "..\SathwareEngine\DesktopWindow.h"
 
-void Controller::Execute()
+void Controller::WriteCPU(ubyte val)
 {
-	if (mPollFlag)
+	mStrobe = IsBitOn<0>(val);
+	if (!mStrobe)
+		return;
+
+	//Games strobe once per frame or a few times in a row to reread around DMC conflicts, every strobe in a frame sees the same buttons
+	const ubyte8 frame = Bus.mpPPU->GetFrameCount();
+	if (frame != mSampledFrame)
 	{
-		mInputState = 0;
-		mCurrButtonIndex = 0;
-		for (unsigned int mButtonIndex = 0; mButtonIndex < 8; ++mButtonIndex)
-		{
-			//if button is pressed
-			if (Window.KeyIsPressed(mButtons[mButtonIndex]))
-				mInputState |= (1 << mButtonIndex);
-		}
+		mButtons = mpSource != nullptr ? mpSource->GetButtons(frame) : std::array<ubyte, 2u>{};
+		mSampledFrame = frame;
 	}
+	mShift[0] = 0xff00u | mButtons[0];
+	mShift[1] = 0xff00u | mButtons[1];
 }
 
-void Controller::WriteCPU(bool setStrobe)
+ubyte Controller::ReadCPU(unsigned int port)
 {
-	mPollFlag = setStrobe;
-}
+	//While the strobe is held the shift register keeps reloading, so reads return A
+	if (mStrobe)
+		return mButtons[port] & 0x01u;
 
-ubyte Controller::ReadCPU()
-{
-	if (mPollFlag)
-	{
-		return mInputState & 0x01u;
-	}
-	else if (mCurrButtonIndex < 8)
-	{
-		return (mInputState >> (mCurrButtonIndex++)) & 0x01u;
-	}
-	else
-		return 1u;
-}
\ No newline at end of file
+	const ubyte bit = mShift[port] & 0x01u;
+	mShift[port] = (mShift[port] >> 1u) | 0x8000u;
+	return bit;
+}
@@ -1,28 +1,33 @@
 #pragma once
 #include "CommonTypes.h"
+#include "InputSource.h"
+#include <array>
 
+//The two standard controller ports, $4016 and $4017
+//Buttons come from an InputSource once per frame when the game strobes, nothing runs between accesses
 class Controller
 {
 public:
-	Controller(class BUS& bus, class DesktopWindow& window)
-		: Bus(bus), Window(window)
+	Controller(class BUS& bus)
+		: Bus(bus)
 	{}
-	void Execute();
-	//CPU tells controller to start or stop polling
-	void WriteCPU(bool setStrobe);
-	//CPU reads input state from controller
-	ubyte ReadCPU();
+	//nullptr unplugs both controllers
+	void SetInputSource(InputSource* source)
+	{
+		mpSource = source;
+	}
+	//CPU writes $4016, bit 0 is the strobe, both controllers reload their shift registers while it is 1
+	void WriteCPU(ubyte val);
+	//CPU reads $4016 for port 0 and $4017 for port 1
+	ubyte ReadCPU(unsigned int port);
 private:
 	BUS& Bus;
-	DesktopWindow& Window;
+	InputSource* mpSource = nullptr;
 
-	//Dictates whether the controller is currently polling input or not
-	bool mPollFlag = false;
-	//Current button to read
-	unsigned int mCurrButtonIndex = 0;
-	//bits: 0 = A, 1 = B, 2 = Select, 3 = Start, 4 = Up, 5 = Down, 6 = Left, 7 = Right
-	unsigned int mInputState = 0;
-	//Keyboard keys: Space B E T W S A D
-	int mButtons[8] = {0x20, 'B', 'E', 'T', 'W', 'S', 'A', 'D'};
+	bool mStrobe = false;
+	//Buttons of both controllers in the frame they were sampled in, bits: 0 = A, 1 = B, 2 = Select, 3 = Start, 4 = Up, 5 = Down, 6 = Left, 7 = Right
+	std::array<ubyte, 2u> mButtons = {};
+	ubyte8 mSampledFrame = ~0ull;
+	//Reads shift out bit 0, official controllers shift in 1s so every read after the 8th returns 1
+	std::array<ubyte2, 2u> mShift = { 0xffffu, 0xffffu };
 };
-
@@ -0,0 +1,53 @@
+#Writes RomDatabase.inl, the table RomInfo::Find searches, from nes20db.xml, Source: "https://www.nesdev.org/wiki/NES_2.0_XML_Database"
+#Usage: python GenerateRomDatabase.py nes20db.xml [RomDatabase.inl], RomDatabase.xml is a subset in the same format
+import os
+import sys
+import xml.etree.ElementTree as ElementTree
+
+mirrorings = {'H': 'Mirroring::Horizontal', 'V': 'Mirroring::Vertical'}
+regions = ['Region::NTSC', 'Region::PAL', 'Region::Multiple', 'Region::Dendy']
+
+#NES 2.0 shift count of a RAM element's size, 64 << n bytes, 0 if there is none, sizes that aren't a power of 2 are rounded up
+def Shift(element):
+	size = int(element.get('size', '0')) if element is not None else 0
+	if size == 0:
+		return 0
+	shift = 1
+	while (64 << shift) < size:
+		shift += 1
+	return shift
+
+def Main():
+	if len(sys.argv) < 2:
+		sys.exit('Usage: python GenerateRomDatabase.py nes20db.xml [RomDatabase.inl]')
+
+	#Each game's file name is in the comment before it
+	parser = ElementTree.XMLParser(target=ElementTree.TreeBuilder(insert_comments=True))
+	name = ''
+	entries = {}
+	for element in ElementTree.parse(sys.argv[1], parser).getroot():
+		if element.tag is ElementTree.Comment:
+			name = element.text.strip()
+			continue
+		rom, pcb, console = element.find('rom'), element.find('pcb'), element.find('console')
+		if element.tag != 'game' or rom is None or pcb is None:
+			continue
+		crc, size = int(rom.get('crc32'), 16), int(rom.get('size'))
+		#Four screen and mapper controlled mirroring are up to the mapper, the value here doesn't matter
+		mirroring = mirrorings.get(pcb.get('mirroring'), 'Mirroring::Horizontal')
+		region = regions[int(console.get('region', '0')) & 3] if console is not None else regions[0]
+		entries[(crc, size)] = '\t{{ 0x{:08x}u, 0x{:x}u, {}, {}, {}, {}, {}, {}, {}, {} }},//{}\n'.format(crc, size,
+			int(pcb.get('mapper', '0')), int(pcb.get('submapper', '0')), mirroring, region,
+			Shift(element.find('prgram')), Shift(element.find('prgnvram')), Shift(element.find('chrram')), Shift(element.find('chrnvram')), name)
+	if not entries:
+		sys.exit('No games found in ' + sys.argv[1])
+
+	with open(sys.argv[2] if len(sys.argv) > 2 else 'RomDatabase.inl', 'w') as out:
+		out.write('//Generated by GenerateRomDatabase.py from {}, don\'t edit\n'.format(os.path.basename(sys.argv[1])))
+		out.write('static constexpr RomInfo database[] =\n{\n')
+		for key in sorted(entries):
+			out.write(entries[key])
+		out.write('};\n')
+	print('{} games'.format(len(entries)))
+
+Main()
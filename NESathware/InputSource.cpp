@@ -0,0 +1,106 @@
+#include "InputSource.h"
+#include "..\SathwareEngine\DesktopWindow.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+//Script letters from the highest button bit to the lowest
+static constexpr char buttonLetters[9] = "RLDUTSBA";
+
+//Parse one controller's "RLDUTSBA" field, false if it isn't one
+static bool ParseButtons(const std::string& field, ubyte& buttons)
+{
+	if (field.size() != 8u)
+		return false;
+	buttons = 0;
+	for (unsigned int i = 0; i < 8u; ++i)
+	{
+		if (field[i] == buttonLetters[i])
+			buttons |= 0x80u >> i;
+		else if (field[i] != '.')
+			return false;
+	}
+	return true;
+}
+
+static std::string FormatButtons(ubyte buttons)
+{
+	std::string field(8u, '.');
+	for (unsigned int i = 0; i < 8u; ++i)
+	{
+		if (buttons & (0x80u >> i))
+			field[i] = buttonLetters[i];
+	}
+	return field;
+}
+
+std::array<ubyte, 2u> KeyboardInput::GetButtons(ubyte8 frame)
+{
+	std::array<ubyte, 2u> buttons = {};
+	for (unsigned int controller = 0; controller < 2u; ++controller)
+	{
+		for (unsigned int button = 0; button < 8u; ++button)
+		{
+			if (Window.KeyIsPressed(mKeys[controller][button]))
+				buttons[controller] |= 1u << button;
+		}
+	}
+	return buttons;
+}
+
+ScriptedInput::ScriptedInput(const std::filesystem::path& file)
+{
+	std::ifstream stream(file);
+	if (!stream)
+		throw std::runtime_error("Failed to open input script " + file.string());
+
+	std::string line;
+	for (unsigned int lineNumber = 1u; std::getline(stream, line); ++lineNumber)
+	{
+		line.erase(std::find(line.begin(), line.end(), '#'), line.end());
+		std::istringstream fields(line);
+		Change change;
+		std::string controller1, controller2;
+		if (!(fields >> change.Frame))
+		{
+			//Blank and comment lines
+			if (line.find_first_not_of(" \t\r") == std::string::npos)
+				continue;
+			throw std::runtime_error("Bad frame number on line " + std::to_string(lineNumber) + " of " + file.string());
+		}
+		if (!(fields >> controller1 >> controller2) || !ParseButtons(controller1, change.Buttons[0]) || !ParseButtons(controller2, change.Buttons[1]))
+			throw std::runtime_error("Bad buttons on line " + std::to_string(lineNumber) + " of " + file.string());
+		if (!mChanges.empty() && change.Frame < mChanges.back().Frame)
+			throw std::runtime_error("Frames go backwards on line " + std::to_string(lineNumber) + " of " + file.string());
+		mChanges.push_back(change);
+	}
+}
+
+std::array<ubyte, 2u> ScriptedInput::GetButtons(ubyte8 frame)
+{
+	//Last change at or before frame, nothing is held before the first one
+	auto next = std::upper_bound(mChanges.begin(), mChanges.end(), frame, [](ubyte8 frame, const Change& change) { return frame < change.Frame; });
+	if (next == mChanges.begin())
+		return {};
+	return std::prev(next)->Buttons;
+}
+
+InputRecorder::InputRecorder(InputSource& source, const std::filesystem::path& file)
+	: Source(source), mFile(file, std::ofstream::trunc | std::ofstream::out)
+{
+	if (!mFile)
+		throw std::runtime_error("Failed to create input recording " + file.string());
+	mFile << "#frame controller1 controller2\n";
+}
+
+std::array<ubyte, 2u> InputRecorder::GetButtons(ubyte8 frame)
+{
+	const std::array<ubyte, 2u> buttons = Source.GetButtons(frame);
+	if (buttons != mLastButtons)
+	{
+		mFile << frame << ' ' << FormatButtons(buttons[0]) << ' ' << FormatButtons(buttons[1]) << '\n';
+		mLastButtons = buttons;
+	}
+	return buttons;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "CommonTypes.h"
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+//Where the controllers get their buttons from, the console asks once per frame, the first time the game strobes the controllers in it
+//Source: "https://www.nesdev.org/wiki/Standard_controller"
+class InputSource
+{
+public:
+	//Bits of a controller's button byte, in the order the controller shifts them out
+	enum Button : ubyte
+	{
+		A = 0x01u,
+		B = 0x02u,
+		Select = 0x04u,
+		Start = 0x08u,
+		Up = 0x10u,
+		Down = 0x20u,
+		Left = 0x40u,
+		Right = 0x80u
+	};
+
+	virtual ~InputSource() = default;
+	//Buttons held on controller 1 and 2 in frame, frames only go forward
+	virtual std::array<ubyte, 2u> GetButtons(ubyte8 frame) = 0;
+};
+
+//Keyboard of the emulator's window
+class KeyboardInput : public InputSource
+{
+public:
+	KeyboardInput(class DesktopWindow& window)
+		: Window(window)
+	{}
+	std::array<ubyte, 2u> GetButtons(ubyte8 frame) override;
+private:
+	DesktopWindow& Window;
+	//Virtual key codes in Button order, controller 1: Space B E T W S A D, controller 2: K J U I and the arrow keys
+	int mKeys[2u][8u] =
+	{
+		{ 0x20, 'B', 'E', 'T', 'W', 'S', 'A', 'D' },
+		{ 'K', 'J', 'U', 'I', 0x26, 0x28, 0x25, 0x27 }
+	};
+};
+
+//Buttons set through code, from any thread
+class ProgrammaticInput : public InputSource
+{
+public:
+	void SetButtons(unsigned int controller, ubyte buttons)
+	{
+		mButtons[controller] = buttons;
+	}
+	std::array<ubyte, 2u> GetButtons(ubyte8 frame) override
+	{
+		return { mButtons[0].load(), mButtons[1].load() };
+	}
+private:
+	std::atomic<ubyte> mButtons[2u] = {};
+};
+
+//Plays back an input script or a recording made by InputRecorder
+//Each line is "frame controller1 controller2", the buttons held from that frame on, in "RLDUTSBA" order with '.' for buttons that aren't held, # starts a comment
+class ScriptedInput : public InputSource
+{
+public:
+	//Throws std::runtime_error if the file can't be read or a line is malformed
+	ScriptedInput(const std::filesystem::path& file);
+	std::array<ubyte, 2u> GetButtons(ubyte8 frame) override;
+private:
+	struct Change
+	{
+		ubyte8 Frame;
+		std::array<ubyte, 2u> Buttons;
+	};
+	//Sorted by frame
+	std::vector<Change> mChanges;
+};
+
+//Passes another source's buttons through and writes every change to a file ScriptedInput can replay
+class InputRecorder : public InputSource
+{
+public:
+	InputRecorder(InputSource& source, const std::filesystem::path& file);
+	std::array<ubyte, 2u> GetButtons(ubyte8 frame) override;
+
+	InputRecorder(const InputRecorder& other) = delete;
+	InputRecorder(const InputRecorder&& other) = delete;
+	InputRecorder& operator=(const InputRecorder& other) = delete;
+private:
+	InputSource& Source;
+	std::ofstream mFile;
+	std::array<ubyte, 2u> mLastButtons = {};
+};
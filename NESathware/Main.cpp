@@ -1,4 +1,5 @@
 #include "NES.h"
+#include "RomLibrary.h"
 #include "../SathwareEngine/SathwareEngine.h"
 #include "../SathwareEngine/DesktopWindow.h"
 #include "../SathwareEngine/Graphics.h"
@@ -6,6 +7,219 @@
 #include "../SathwareEngine/Timer.h"
 #include <iostream>
 #include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+//Print how many frames per second of sprite evaluation bucketing OAM once per frame does, compared to walking all 64 OAM entries on every scanline
+void BenchmarkSpriteEvaluation(unsigned int frames = 100000u)
+{
+    //Sprites spread over the screen, the first 16 share a row to go past the 8 sprite limit
+    ubyte oam[256u];
+    for (unsigned int i = 0; i < 64u; ++i)
+    {
+        oam[i * 4u] = (ubyte)(i < 16u ? 100u : (i * 37u) % 240u);
+        oam[i * 4u + 1u] = (ubyte)i;
+        oam[i * 4u + 2u] = 0;
+        oam[i * 4u + 3u] = (ubyte)(i * 53u);
+    }
+
+    for (unsigned int spriteHeight = 8u; spriteHeight <= 16u; spriteHeight += 8u)
+    {
+        std::vector<ScanlineSprites> bucketed(240u);
+        Timer timer;
+        for (unsigned int frame = 0; frame < frames; ++frame)
+        {
+            //Move a sprite every frame so nothing gets hoisted out of the loop
+            oam[252u] = (ubyte)frame;
+            PPURenderer::EvaluateSprites(oam, spriteHeight, bucketed.data());
+        }
+        float bucketSeconds = timer.GetElapsedSeconds();
+
+        std::vector<ScanlineSprites> walked(240u);
+        for (unsigned int frame = 0; frame < frames; ++frame)
+        {
+            oam[252u] = (ubyte)frame;
+            const Sprite* const sprites = reinterpret_cast<const Sprite*>(oam);
+            for (unsigned int scanline = 0; scanline < 240u; ++scanline)
+            {
+                ScanlineSprites& lineSprites = walked[scanline];
+                lineSprites.Count = 0;
+                lineSprites.Overflow = false;
+                for (unsigned int i = 0; i < 64u; ++i)
+                {
+                    const unsigned int top = sprites[i].PosYTop + 1u;
+                    if (scanline < top || scanline >= top + spriteHeight)
+                        continue;
+                    if (lineSprites.Count == 8u)
+                        lineSprites.Overflow = true;
+                    else
+                        lineSprites.OAMIndexes[lineSprites.Count++] = (ubyte)i;
+                }
+            }
+        }
+        float walkSeconds = timer.GetElapsedSeconds();
+
+        bool same = true;
+        for (unsigned int scanline = 0; scanline < 240u; ++scanline)
+            same = same && bucketed[scanline].Count == walked[scanline].Count && bucketed[scanline].Overflow == walked[scanline].Overflow &&
+                std::equal(bucketed[scanline].OAMIndexes, bucketed[scanline].OAMIndexes + bucketed[scanline].Count, walked[scanline].OAMIndexes);
+
+        std::cout << "8x" << spriteHeight << " sprites\n";
+        std::cout << std::fixed << std::setprecision(1) << "Per frame bucketing: " << frames / bucketSeconds << " frames/second\n";
+        std::cout << std::fixed << std::setprecision(1) << "Per scanline OAM walk: " << frames / walkSeconds << " frames/second"
+            << (same ? "\n" : " (results differ!)\n");
+    }
+}
+
+//Print emulation speed for frame skip ratios 0 to maxSkip
+void BenchmarkFrameSkip(NES& nes, unsigned int maxSkip, unsigned int frames = 600u)
+{
+    for (unsigned int skip = 0; skip <= maxSkip; ++skip)
+    {
+        nes.SetFrameSkip(skip);
+        Timer timer;
+        nes.RunFrames(frames);
+        float seconds = timer.GetElapsedSeconds();
+        std::cout << "Frame skip " << skip << ": " << std::fixed << std::setprecision(1) << frames / seconds << " frames/second\n";
+    }
+    nes.SetFrameSkip(0);
+}
+
+//Print how long converting the last frame takes with the NTSC filter compared to the flat palette lookup
+void BenchmarkNTSCFilter(NES& nes, unsigned int frames = 600u)
+{
+    nes.RunFrames(1u);
+    std::vector<Color> flatFrame(256u * 240u);
+    std::vector<Color> ntscFrame(NTSCFilter::outputWidth * NTSCFilter::height);
+    NTSCFilter filter;
+
+    Timer timer;
+    for (unsigned int frame = 0; frame < frames; ++frame)
+        nes.mPPU.ConvertFrame(flatFrame.data());
+    float flatSeconds = timer.GetElapsedSeconds();
+    for (unsigned int frame = 0; frame < frames; ++frame)
+        filter.Filter(nes.mPPU.GetFrameIndices(), nes.mPPU.GetLineEmphasis(), ntscFrame.data());
+    float ntscSeconds = timer.GetElapsedSeconds();
+
+    std::cout << std::fixed << std::setprecision(1) << "Palette lookup: " << frames / flatSeconds << " frames/second\n";
+    std::cout << std::fixed << std::setprecision(1) << "NTSC filter: " << frames / ntscSeconds << " frames/second\n";
+}
+
+//Print how many cartridge reads per second the inline bank table lookup does, compared to dispatching every read through a virtual call like cartridges used to
+void BenchmarkCartridgeReads(NES& nes, unsigned int reads = 100000000u)
+{
+    struct VirtualCartridge
+    {
+        virtual ~VirtualCartridge() = default;
+        virtual ubyte ReadCPU(ubyte2 address) const = 0;
+    };
+    struct ForwardingCartridge : public VirtualCartridge
+    {
+        const Mapper& Cartridge;
+        ForwardingCartridge(const Mapper& cartridge)
+            : Cartridge(cartridge)
+        {}
+        ubyte ReadCPU(ubyte2 address) const override
+        {
+            return Cartridge.ReadCPU(address);
+        }
+    };
+    const ForwardingCartridge forwarding(*nes.mpCartridge);
+    //Loaded through volatile so the compiler can't see the dynamic type and devirtualize the calls
+    const VirtualCartridge* volatile pVirtual = &forwarding;
+    const VirtualCartridge& virtualCartridge = *pVirtual;
+    const Mapper& cartridge = *nes.mpCartridge;
+
+    //Mostly sequential PRG addresses with a jump every few reads, like opcode fetches
+    Timer timer;
+    unsigned int directSum = 0;
+    for (unsigned int i = 0; i < reads; ++i)
+        directSum += cartridge.ReadCPU((ubyte2)(0x8000u | ((i + (i >> 3u) * 97u) & 0x7fffu)));
+    float directSeconds = timer.GetElapsedSeconds();
+    unsigned int virtualSum = 0;
+    for (unsigned int i = 0; i < reads; ++i)
+        virtualSum += virtualCartridge.ReadCPU((ubyte2)(0x8000u | ((i + (i >> 3u) * 97u) & 0x7fffu)));
+    float virtualSeconds = timer.GetElapsedSeconds();
+
+    std::cout << std::fixed << std::setprecision(1) << "Inline reads: " << reads / directSeconds / 1000000.0f << " million/second\n";
+    std::cout << std::fixed << std::setprecision(1) << "Virtual reads: " << reads / virtualSeconds / 1000000.0f << " million/second"
+        << (directSum == virtualSum ? "\n" : " (results differ!)\n");
+}
+
+//Index the ROMs under directory twice and print how fast each scan went, the second scan should only read the cache
+void BenchmarkLibraryScan(const std::filesystem::path& directory)
+{
+    RomLibrary library(directory / "library.cache");
+    for (unsigned int scan = 0; scan < 2u; ++scan)
+    {
+        LibraryScanStats stats = library.Scan(directory);
+        std::cout << std::fixed << std::setprecision(1) << "Scanned " << stats.Scanned << " of " << stats.Files << " files in " << stats.Seconds * 1000.0f << " ms, "
+            << stats.Files / stats.Seconds << " files/second, " << stats.BytesScanned / stats.Seconds / 1000000.0f << " MB/second\n";
+    }
+}
+
+//Print how many deltas per second and how much aliasing every BlipBuffer quality has
+//A square wave with harmonics far past nyquist is synthesized on exact DFT bins, all energy outside its harmonic bins is aliasing
+void BenchmarkResampler(unsigned int sampleRate = 44100u, unsigned int deltas = 10000000u)
+{
+    constexpr unsigned int dftSize = 4096u;
+    //Odd, so harmonics folded back from above nyquist miss the harmonic bins, about 4kHz at 44.1kHz
+    constexpr unsigned int squareBin = 373u;
+    constexpr unsigned int halfPeriod = 1000u;
+    const double clockRate = 2.0 * halfPeriod * squareBin * sampleRate / dftSize;
+    constexpr const char* names[3u] = { "Fast", "Normal", "High" };
+    constexpr double pi = std::numbers::pi;
+
+    for (unsigned int quality = 0; quality < 3u; ++quality)
+    {
+        //Aliasing, the first dftSize samples let the DC filter settle
+        BlipBuffer square(clockRate, sampleRate, dftSize * 2u, BlipBuffer::Quality(quality));
+        std::vector<float> samples;
+        float delta = 1.0f;
+        for (unsigned int clock = 0; samples.size() < dftSize * 2u; clock += halfPeriod * 4u)
+        {
+            for (unsigned int edge = 0; edge < 4u; ++edge, delta = -delta)
+                square.AddDelta(edge * halfPeriod, delta);
+            square.EndBlock(halfPeriod * 4u);
+            const size_t start = samples.size();
+            samples.resize(start + square.SamplesAvailable());
+            samples.resize(start + square.ReadSamples(&samples[start], samples.size() - start));
+        }
+
+        double signal = 0.0;
+        double alias = 0.0;
+        for (unsigned int bin = 1u; bin < dftSize / 2u; ++bin)
+        {
+            double re = 0.0;
+            double im = 0.0;
+            for (unsigned int i = 0; i < dftSize; ++i)
+            {
+                const double angle = 2.0 * pi * bin * i / dftSize;
+                re += samples[dftSize + i] * std::cos(angle);
+                im -= samples[dftSize + i] * std::sin(angle);
+            }
+            (bin % squareBin == 0 ? signal : alias) += re * re + im * im;
+        }
+
+        //Throughput, a delta every 37 clocks and a block per sample buffer
+        BlipBuffer blip(APU_2A03::clockRate, sampleRate, 4096u, BlipBuffer::Quality(quality));
+        std::vector<float> out(4096u);
+        Timer timer;
+        for (unsigned int i = 0; i < deltas; i += 256u)
+        {
+            for (unsigned int j = 0; j < 256u; ++j)
+                blip.AddDelta(j * 37u, (j & 1u) ? 0.1f : -0.1f);
+            blip.EndBlock(256u * 37u);
+            blip.ReadSamples(out.data(), out.size());
+        }
+        float seconds = timer.GetElapsedSeconds();
+
+        std::cout << names[quality] << ": " << std::fixed << std::setprecision(1) << deltas / seconds / 1000000.0f << " million deltas/second, aliasing "
+            << 10.0 * std::log10(alias / signal) << "dB\n";
+    }
+}
 
 int main()
 {
@@ -18,17 +232,28 @@ int main()
 
         DesktopWindow desktopWindow(256u, 240u, dllInstance, SW_NORMAL);
         Graphics directXGFX(desktopWindow);
-        Audio audio;
-        audio.PlaySine();
+        directXGFX.StartPresenter();
+        AudioStream audioStream(44100u, 60u);
+        Audio audio(audioStream);
+        AudioRateControl audioRateControl(audioStream);
         // NES nes("DonkeyKong.nes", directXGFX, desktopWindow);
+        // nes.SetAudioStream(&audioStream, &audioRateControl);
         Timer timer;
 
         /*nes.mPPU.DisplayCHRROM();
         directXGFX.Render();*/
+        //BenchmarkSpriteEvaluation();
+        //BenchmarkFrameSkip(nes, 8u);
+        //BenchmarkNTSCFilter(nes);
+        //BenchmarkCartridgeReads(nes);
+        //BenchmarkLibraryScan("ROMs");
+        //BenchmarkResampler();
 
         while (desktopWindow.IsRunning())
         {
             // nes.Run(timer.GetElapsedSeconds());
+            //Or let the sound card pace emulation, without audioRateControl in SetAudioStream
+            // nes.RunFramePacedByAudio();
         }
     }
     catch (Exception& e)
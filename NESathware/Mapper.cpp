@@ -1 +1,296 @@
-#include "Mapper.h"
\ No newline at end of file
+#include "Mapper.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+Mapper::Mapper(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+	: mMirroring(rom->GetMirroring()), mpRom(std::move(rom))
+{
+	//Carts without CHR ROM get their own CHR RAM, NES 2.0 files may give its size
+	if (mpRom->GetCHR() == nullptr)
+		mCHRRAM.resize(std::max<size_t>(mpRom->GetCHRRAMSize() + mpRom->GetCHRNVRAMSize(), 0x2000u));
+	mpCHR = mCHRRAM.empty() ? mpRom->GetCHR() : mCHRRAM.data();
+	mCHRSize = mCHRRAM.empty() ? mpRom->GetCHRSize() : mCHRRAM.size();
+	//Banks are mapped in whole windows
+	if (mpRom->GetPRGSize() % 0x2000u != 0 || mCHRSize % 0x400u != 0)
+		throw std::runtime_error("ROM size isn't a multiple of the bank size");
+
+	//The whole PRG RAM is kept in the save file when any of it is battery backed
+	const size_t prgRAMSize = mpRom->GetPRGRAMSize() + mpRom->GetPRGNVRAMSize();
+	if (mpRom->GetPRGNVRAMSize() != 0 && !saveFile.empty())
+	{
+		try
+		{
+			mpBatteryRAM = std::make_unique<BatteryRAM>(saveFile, prgRAMSize);
+			mpPRGRAM = mpBatteryRAM->GetData();
+		}
+		//No save can be made or read, the game still runs, it just forgets at power off
+		catch (const Exception&)
+		{}
+	}
+	if (mpPRGRAM == nullptr && prgRAMSize != 0)
+	{
+		mPRGRAM.resize(prgRAMSize);
+		mpPRGRAM = mPRGRAM.data();
+	}
+	if (mpPRGRAM != nullptr)
+	{
+		mPRGRAMMask = (ubyte2)(std::bit_floor(std::min<size_t>(prgRAMSize, 0x2000u)) - 1u);
+		//Trainers go to $7000 - $71ff
+		if (mpRom->GetTrainer() != nullptr && mPRGRAMMask >= 0x11ffu)
+			memcpy(&mpPRGRAM[0x1000u], mpRom->GetTrainer(), 0x200u);
+	}
+	SetPRGRAMAccess(true, true);
+
+	//Power on layout is NROM's: the first 16KB at $8000, the last 16KB at $c000 and the first 8KB of CHR
+	SetPRGBank16K(0, 0);
+	SetPRGBank16K(1, NumPRGBanks8K() / 2u - 1u);
+	SetCHRBank8K(0);
+}
+
+void Mapper::SetPRGBank8K(unsigned int window, unsigned int bank)
+{
+	mPRGWindows[window] = mpRom->GetPRG() + (bank % NumPRGBanks8K()) * 0x2000u;
+}
+
+void Mapper::SetPRGBank16K(unsigned int window, unsigned int bank)
+{
+	SetPRGBank8K(window * 2u, bank * 2u);
+	SetPRGBank8K(window * 2u + 1u, bank * 2u + 1u);
+}
+
+void Mapper::SetPRGBank32K(unsigned int bank)
+{
+	SetPRGBank16K(0, bank * 2u);
+	SetPRGBank16K(1, bank * 2u + 1u);
+}
+
+void Mapper::SetCHRBank1K(unsigned int window, unsigned int bank)
+{
+	const ubyte* const page = mpCHR + (bank % (unsigned int)(mCHRSize / 0x400u)) * 0x400u;
+	if (mCHRWindows[window] != page)
+	{
+		mCHRWindows[window] = page;
+		mCHRBankChanges |= 1u << window;
+		mDirtyTiles[window] = ~0ull;
+	}
+}
+
+void Mapper::SetCHRBank2K(unsigned int window, unsigned int bank)
+{
+	SetCHRBank1K(window * 2u, bank * 2u);
+	SetCHRBank1K(window * 2u + 1u, bank * 2u + 1u);
+}
+
+void Mapper::SetCHRBank4K(unsigned int window, unsigned int bank)
+{
+	SetCHRBank2K(window * 2u, bank * 2u);
+	SetCHRBank2K(window * 2u + 1u, bank * 2u + 1u);
+}
+
+void Mapper::SetCHRBank8K(unsigned int bank)
+{
+	SetCHRBank4K(0, bank * 2u);
+	SetCHRBank4K(1, bank * 2u + 1u);
+}
+
+Mapper0::Mapper0(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+	: Mapper(std::move(rom), saveFile)
+{}
+
+Mapper1::Mapper1(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+	: Mapper(std::move(rom), saveFile)
+{
+	UpdateBanks();
+}
+
+void Mapper1::WriteRegister(ubyte val, ubyte2 address)
+{
+	//Writing a 1 to bit 7 resets the shift register and fixes the last bank at $c000
+	if (IsBitOn<7>(val))
+	{
+		mShift = 0x10u;
+		mControl |= 0x0cu;
+		UpdateBanks();
+		return;
+	}
+
+	const bool full = IsBitOn<0>(mShift);
+	mShift = (mShift >> 1u) | ((val & 0x01u) << 4u);
+	if (!full)
+		return;
+
+	//Bits 13 and 14 of the 5th write's address pick the register
+	switch ((address >> 13u) & 0x03u)
+	{
+	case 0: mControl = mShift; break;
+	case 1: mCHRBank0 = mShift; break;
+	case 2: mCHRBank1 = mShift; break;
+	case 3: mPRGBank = mShift; break;
+	}
+	mShift = 0x10u;
+	UpdateBanks();
+}
+
+void Mapper1::UpdateBanks()
+{
+	constexpr Mirroring mirroring[4u] = { Mirroring::SingleScreenLower, Mirroring::SingleScreenUpper, Mirroring::Vertical, Mirroring::Horizontal };
+	mMirroring = mirroring[mControl & 0x03u];
+
+	//SUROM and SXROM carts use bit 4 of the CHR register to pick the 256KB half of a 512KB PRG ROM
+	const unsigned int outerBank = (NumPRGBanks8K() > 32u && IsBitOn<4>(mCHRBank0)) ? 0x10u : 0;
+	const unsigned int prgBank = outerBank | (mPRGBank & 0x0fu);
+	//MMC1B and later disable PRG RAM with bit 4
+	SetPRGRAMAccess(!IsBitOn<4>(mPRGBank), true);
+	switch ((mControl >> 2u) & 0x03u)
+	{
+	case 0:
+	case 1:
+		//32KB mode ignores the low bit
+		SetPRGBank32K(prgBank >> 1u);
+		break;
+	case 2:
+		//First bank fixed at $8000
+		SetPRGBank16K(0, outerBank);
+		SetPRGBank16K(1, prgBank);
+		break;
+	case 3:
+		//Last bank fixed at $c000
+		SetPRGBank16K(0, prgBank);
+		SetPRGBank16K(1, outerBank | 0x0fu);
+		break;
+	}
+
+	if (IsBitOn<4>(mControl))
+	{
+		SetCHRBank4K(0, mCHRBank0);
+		SetCHRBank4K(1, mCHRBank1);
+	}
+	else
+		SetCHRBank8K(mCHRBank0 >> 1u);
+}
+
+Mapper2::Mapper2(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+	: Mapper(std::move(rom), saveFile)
+{}
+
+Mapper3::Mapper3(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+	: Mapper(std::move(rom), saveFile)
+{}
+
+Mapper4::Mapper4(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+	: Mapper(std::move(rom), saveFile)
+{
+	mCountsScanlines = true;
+	UpdateBanks();
+}
+
+void Mapper4::WriteRegister(ubyte val, ubyte2 address)
+{
+	//Each 8KB range has two registers, told apart by bit 0 of the address
+	const bool odd = IsBitOn<0>(address);
+	switch ((address >> 13u) & 0x03u)
+	{
+	case 0:
+		if (odd)
+			mBankRegisters[mBankSelect & 0x07u] = val;
+		else
+			mBankSelect = val;
+		UpdateBanks();
+		break;
+	case 1:
+		if (odd)
+			SetPRGRAMAccess(IsBitOn<7>(val), !IsBitOn<6>(val));//PRG RAM chip enable and write protect
+		else
+			mMirroring = IsBitOn<0>(val) ? Mirroring::Horizontal : Mirroring::Vertical;
+		break;
+	case 2:
+		if (odd)
+			mIRQReload = true;
+		else
+			mIRQLatch = val;
+		break;
+	case 3:
+		//Disabling also acknowledges a pending IRQ
+		mIRQEnabled = odd;
+		if (!odd)
+			mIRQPending = false;
+		break;
+	}
+}
+
+void Mapper4::ClockScanline()
+{
+	//A counter of 0 or a reload request loads the latch, the IRQ fires whenever the counter ends up 0, Source: "https://www.nesdev.org/wiki/MMC3#IRQ_Specifics"
+	if (mIRQCounter == 0 || mIRQReload)
+	{
+		mIRQCounter = mIRQLatch;
+		mIRQReload = false;
+	}
+	else
+		--mIRQCounter;
+	if (mIRQCounter == 0 && mIRQEnabled)
+		mIRQPending = true;
+}
+
+void Mapper4::UpdateBanks()
+{
+	//R6 is at $8000 or $c000, the second last bank is at the other one
+	const unsigned int secondLast = NumPRGBanks8K() - 2u;
+	const bool prgMode = IsBitOn<6>(mBankSelect);
+	SetPRGBank8K(0, prgMode ? secondLast : (mBankRegisters[6] & 0x3fu));
+	SetPRGBank8K(1, mBankRegisters[7] & 0x3fu);
+	SetPRGBank8K(2, prgMode ? (mBankRegisters[6] & 0x3fu) : secondLast);
+	SetPRGBank8K(3, secondLast + 1u);
+
+	//R0 and R1 are 2KB banks that ignore their low bit, R2 - R5 are 1KB banks, inversion swaps the two halves of the pattern tables
+	const unsigned int inversion = IsBitOn<7>(mBankSelect) ? 4u : 0;
+	SetCHRBank1K(inversion + 0u, mBankRegisters[0] & 0xfeu);
+	SetCHRBank1K(inversion + 1u, mBankRegisters[0] | 0x01u);
+	SetCHRBank1K(inversion + 2u, mBankRegisters[1] & 0xfeu);
+	SetCHRBank1K(inversion + 3u, mBankRegisters[1] | 0x01u);
+	for (unsigned int r = 2u; r < 6u; ++r)
+		SetCHRBank1K((r + 2u) ^ inversion, mBankRegisters[r]);
+}
+
+Mapper7::Mapper7(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+	: Mapper(std::move(rom), saveFile)
+{
+	SetPRGBank32K(0);
+	mMirroring = Mirroring::SingleScreenLower;
+}
+
+//Registry of supported mappers by iNES number
+template<class T>
+static std::unique_ptr<Mapper> MakeMapper(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+{
+	return std::make_unique<T>(std::move(rom), saveFile);
+}
+
+struct MapperEntry
+{
+	ubyte2 Number;
+	std::unique_ptr<Mapper>(*Create)(std::shared_ptr<const Rom>, const std::filesystem::path&);
+};
+
+static constexpr MapperEntry mappers[] =
+{
+	{ 0, MakeMapper<Mapper0> },//NROM
+	{ 1, MakeMapper<Mapper1> },//MMC1
+	{ 2, MakeMapper<Mapper2> },//UxROM
+	{ 3, MakeMapper<Mapper3> },//CNROM
+	{ 4, MakeMapper<Mapper4> },//MMC3
+	{ 7, MakeMapper<Mapper7> },//AxROM
+};
+
+std::unique_ptr<Mapper> Mapper::Create(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile)
+{
+	for (const MapperEntry& entry : mappers)
+	{
+		if (entry.Number == rom->GetMapper())
+			return entry.Create(std::move(rom), saveFile);
+	}
+	throw std::runtime_error("Unsupported mapper " + std::to_string(rom->GetMapper()));
+}
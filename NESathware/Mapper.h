@@ -1,95 +1,224 @@
 #pragma once
 #include "CommonTypes.h"
+#include "Rom.h"
+#include "BatteryRAM.h"
 #include <array>
-#include <fstream>
-
-struct Header
-{
-	ubyte Type[4];
-	ubyte size_PRGRom;//size in 16KB units
-	ubyte size_CHRRom;//size in 8KB units
-	ubyte flags6;
-	ubyte flags7;
-	ubyte flags8;
-	ubyte flags9;
-	ubyte flags10;
-	ubyte Padding[5];//Not an actual variable, just padding to make sizeof(header) == 16
-};
+#include <vector>
+#include <memory>
 
+//Cartridge, the CPU and PPU see its ROM and RAM through tables of host pointers, one per 8KB PRG window ($8000 - $ffff) and one per 1KB CHR window ($0000 - $1fff)
+//PRG RAM sits at $6000 - $7fff, carts with a battery keep it in a save file
+//Mappers only repoint the tables when a bank register is written, so reads never do any bank arithmetic
+//Every mapper reads the same way, so ReadCPU, ReadPPU and WritePPU aren't virtual and inline into the BUS, only register writes and scanline clocks are dispatched
 struct Mapper
 {
 	virtual ~Mapper() = default;
-	Mapper(Header& header)
-		: header(header)
-	{}
-	virtual ubyte ReadCPU(ubyte2 address) const = 0;
-	virtual ubyte ReadPPU(ubyte2 address) const = 0;
-	virtual void WriteCPU(ubyte val, ubyte2 address) = 0;
-	virtual void WritePPU(ubyte val, ubyte2 address) = 0;
-	Header header;
-};
+	//PRG and CHR ROM are read in place from the shared image, carts without CHR ROM get their own CHR RAM
+	//Battery backed PRG RAM is mapped from saveFile, only one console at a time saves to a save file, see BatteryRAM, with no saveFile or one that can't be opened it is lost at power off
+	Mapper(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile = {});
+	//Mapper for the ROM's mapper number, throws if the mapper isn't supported, Source: "https://www.nesdev.org/wiki/Mapper"
+	static std::unique_ptr<Mapper> Create(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile = {});
 
-//Source: "https://www.nesdev.org/wiki/NROM"
-//Convert from CPU address to internal storage indexes by subtracting 0x4020 i.e. the range [0x4020, 0xffff] -> [0x0000, 0xbfdf]
-struct Mapper0 : public Mapper
-{
-	Mapper0(Header& header, std::ifstream& fileStream)
-		: Mapper(header)
+	ubyte ReadCPU(ubyte2 address) const
+	{
+		if (address >= 0x8000u)
+			return mPRGWindows[(address >> 13u) & 0x03u][address & 0x1fffu];
+		//Reads of missing or disabled PRG RAM and of $4020 - $5fff are open bus
+		if (address >= 0x6000u && mPRGRAMReadable)
+			return mpPRGRAM[address & mPRGRAMMask];
+		return 0;
+	}
+	ubyte ReadPPU(ubyte2 address) const
+	{
+		return mCHRWindows[(address >> 10u) & 0x07u][address & 0x03ffu];
+	}
+	void WriteCPU(ubyte val, ubyte2 address)
+	{
+		if (address >= 0x8000u)
+			WriteRegister(val, address);
+		else if (address >= 0x6000u && mPRGRAMWritable)
+		{
+			mpPRGRAM[address & mPRGRAMMask] = val;
+			if (mpBatteryRAM != nullptr)
+				mpBatteryRAM->MarkDirty();
+		}
+	}
+	void WritePPU(ubyte val, ubyte2 address)
 	{
-		//Fill PRG ROM
-		fileStream.read(reinterpret_cast<char*>(PRG_ROM), (size_t)header.size_PRGRom * 0x4000u);
-		//Fill CHR ROM
-		fileStream.read(reinterpret_cast<char*>(CHR_ROM), (size_t)header.size_CHRRom * 0x2000u);
+		//CHR ROM can't be written, CHR RAM windows all point into mCHRRAM
+		if (mCHRRAM.empty())
+			return;
+		const ubyte* const page = mCHRWindows[(address >> 10u) & 0x07u];
+		mCHRRAM[(page - mCHRRAM.data()) + (address & 0x03ffu)] = val;
+		//The tile changed in every window that shows the same page
+		for (unsigned int window = 0; window < 8u; ++window)
+		{
+			if (mCHRWindows[window] == page)
+				mDirtyTiles[window] |= 1ull << ((address >> 4u) & 0x3fu);
+		}
 	}
 
-	ubyte ReadCPU(ubyte2 address) const override
+	Mirroring GetMirroring() const
+	{
+		return mMirroring;
+	}
+	//Bitmask of the 1KB CHR windows that were pointed at a different bank since the last call
+	ubyte TakeCHRBankChanges()
+	{
+		const ubyte changes = mCHRBankChanges;
+		mCHRBankChanges = 0;
+		return changes;
+	}
+	//One bit per 16 byte tile of $0000 - $1fff, set when a CHR RAM write or a bank switch changed what the PPU sees there
+	//Word n covers CHR window n, caches of pattern data only have to redo the tiles set since they last cleared them
+	const std::array<ubyte8, 8u>& GetDirtyTiles() const
+	{
+		return mDirtyTiles;
+	}
+	void ClearDirtyTiles()
 	{
-		//CPU memory addresses 0x8000 - 0xffff map to PRG ROM
-		assert(address >= 0x8000u && address <= 0xffff);
+		mDirtyTiles.fill(0);
+	}
 
-		//If PRG ROM is 16KB then mirror
-		ubyte2 internalAddress = (address - 0x8000u) % ((ubyte2)header.size_PRGRom * 0x4000u);
-		return PRG_ROM[internalAddress];
+	//Scanline counters like MMC3's count rises of PPU address line A12, the PPU only works them out for mappers that have one
+	bool CountsScanlines() const
+	{
+		return mCountsScanlines;
+	}
+	virtual void ClockScanline() {}
+	//The cartridge holds the CPU's IRQ line
+	bool IRQPending() const
+	{
+		return mIRQPending;
 	}
 
-	void WriteCPU(ubyte val, ubyte2 address) override 
+	const Rom& GetRom() const
 	{
-		////CPU memory addresses 0x8000 - 0xffff map to PRG ROM
-		//assert(address >= 0x8000u && address <= 0xffff);
+		return *mpRom;
+	}
+protected:
+	//Bank registers at $8000 - $ffff, the base cart has none
+	virtual void WriteRegister(ubyte val, ubyte2 address) {}
 
-		////If PRG ROM is 16KB then mirror
-		//ubyte2 internalAddress = (address - 0x8000u) % ((ubyte2)header.size_PRGRom * 0x4000u);
-		//PRG_ROM[internalAddress] = val;
+	//Bank numbers wrap around the number of banks, so writing a too large bank mirrors like it does on hardware
+	//window is the window of the bank size, e.g. SetPRGBank16K(1, bank) maps $c000 - $ffff
+	void SetPRGBank8K(unsigned int window, unsigned int bank);
+	void SetPRGBank16K(unsigned int window, unsigned int bank);
+	void SetPRGBank32K(unsigned int bank);
+	void SetCHRBank1K(unsigned int window, unsigned int bank);
+	void SetCHRBank2K(unsigned int window, unsigned int bank);
+	void SetCHRBank4K(unsigned int window, unsigned int bank);
+	void SetCHRBank8K(unsigned int bank);
+	unsigned int NumPRGBanks8K() const
+	{
+		return (unsigned int)(mpRom->GetPRGSize() / 0x2000u);
+	}
+	//Chip enable and write protect of mappers that have them, PRG RAM starts out enabled and writable
+	void SetPRGRAMAccess(bool enabled, bool writable)
+	{
+		mPRGRAMReadable = enabled && mpPRGRAM != nullptr;
+		mPRGRAMWritable = mPRGRAMReadable && writable;
 	}
 
-	ubyte ReadPPU(ubyte2 address) const override
+	Mirroring mMirroring;
+	bool mCountsScanlines = false;
+	bool mIRQPending = false;
+private:
+	std::shared_ptr<const Rom> mpRom;
+	//Empty when the cart has CHR ROM
+	std::vector<ubyte> mCHRRAM;
+	//CHR ROM or mCHRRAM
+	const ubyte* mpCHR;
+	size_t mCHRSize;
+	std::array<const ubyte*, 4u> mPRGWindows = {};
+	std::array<const ubyte*, 8u> mCHRWindows = {};
+	//Either mPRGRAM or the battery RAM, nullptr if the cart has none
+	std::vector<ubyte> mPRGRAM;
+	std::unique_ptr<BatteryRAM> mpBatteryRAM;
+	ubyte* mpPRGRAM = nullptr;
+	//Smaller RAM is mirrored through the 8KB window, only the first 8KB of larger RAM is visible
+	ubyte2 mPRGRAMMask = 0;
+	bool mPRGRAMReadable = false;
+	bool mPRGRAMWritable = false;
+	ubyte mCHRBankChanges = 0;
+	//Everything is dirty until the first cache fill
+	std::array<ubyte8, 8u> mDirtyTiles = { ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull, ~0ull };
+};
+
+//Source: "https://www.nesdev.org/wiki/NROM"
+//16KB PRG ROM is mirrored into both halves of $8000 - $ffff
+struct Mapper0 : public Mapper
+{
+	Mapper0(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile);
+};
+
+//Source: "https://www.nesdev.org/wiki/MMC1"
+//Registers are written one bit at a time through a serial shift register
+struct Mapper1 : public Mapper
+{
+	Mapper1(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile);
+	void WriteRegister(ubyte val, ubyte2 address) override;
+private:
+	void UpdateBanks();
+
+	//Bit 4 marks the end, the 5th write finds it in bit 0
+	ubyte mShift = 0x10u;
+	ubyte mControl = 0x0cu;
+	ubyte mCHRBank0 = 0;
+	ubyte mCHRBank1 = 0;
+	ubyte mPRGBank = 0;
+};
+
+//Source: "https://www.nesdev.org/wiki/UxROM"
+//Switchable 16KB at $8000, the last 16KB is fixed at $c000
+struct Mapper2 : public Mapper
+{
+	Mapper2(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile);
+	void WriteRegister(ubyte val, ubyte2 address) override
 	{
-		//Normally PPU memory addresses 0x0000 - 0x1fff map to CHR ROM
-		assert(address < 0x2000);
-		return CHR_ROM[address];
+		SetPRGBank16K(0, val);
 	}
+};
 
-	void WritePPU(ubyte val, ubyte2 address) override
+//Source: "https://www.nesdev.org/wiki/INES_Mapper_003"
+//Fixed PRG like NROM with a switchable 8KB CHR ROM bank
+struct Mapper3 : public Mapper
+{
+	Mapper3(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile);
+	void WriteRegister(ubyte val, ubyte2 address) override
 	{
-		////Normally PPU memory addresses 0x0000 - 0x1fff map to CHR ROM
-		//assert(address < 0x2000);
-		//CHR_ROM[address] = val;
+		SetCHRBank8K(val);
 	}
+};
 
-	//32KB PRG ROM
-	ubyte PRG_ROM[0x8000u];
-	//8KB CHR ROM
-	ubyte CHR_ROM[0x2000u];
+//Source: "https://www.nesdev.org/wiki/MMC3"
+struct Mapper4 : public Mapper
+{
+	Mapper4(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile);
+	void WriteRegister(ubyte val, ubyte2 address) override;
+	void ClockScanline() override;
+private:
+	void UpdateBanks();
+
+	//Register written by the next bank data write, PRG mode in bit 6 and CHR inversion in bit 7
+	ubyte mBankSelect = 0;
+	//R0 - R7
+	ubyte mBankRegisters[8u] = { 0, 2, 4, 5, 6, 7, 0, 1 };
+	//Counts down once per scanline, the IRQ fires when it reaches 0
+	ubyte mIRQCounter = 0;
+	ubyte mIRQLatch = 0;
+	bool mIRQReload = false;
+	bool mIRQEnabled = false;
 };
 
-////Source: "https://www.nesdev.org/wiki/MMC1"
-//struct Mapper1 : public Mapper
-//{
-//	Mapper1(Header& header, std::ifstream& fileStream)
-//		:Mapper(header)
-//	{
-//
-//	}
-//
-//
-//};
\ No newline at end of file
+//Source: "https://www.nesdev.org/wiki/AxROM"
+//Switchable 32KB PRG and single screen mirroring
+struct Mapper7 : public Mapper
+{
+	Mapper7(std::shared_ptr<const Rom> rom, const std::filesystem::path& saveFile);
+	void WriteRegister(ubyte val, ubyte2 address) override
+	{
+		SetPRGBank32K(val & 0x07u);
+		mMirroring = IsBitOn<4>(val) ? Mirroring::SingleScreenUpper : Mirroring::SingleScreenLower;
+	}
+};
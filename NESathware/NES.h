@@ -6,18 +6,22 @@
 #include "PPU_2C02.h"
 #include "APU_2A03.h"
 #include "Controller.h"
+#include "../SathwareEngine/AudioStream.h"
+#include "../SathwareEngine/AudioRateControl.h"
 
 class NES
 {
 public:
-	NES(std::string romFileName, class Graphics& gfx, class DesktopWindow& window)
-		: mBus(), mCPU(mBus), mPPU(mBus, gfx), mAPU(mBus), mController(mBus, window), mpCartridge(LoadRom(romFileName))
+	NES(std::string romFileName, class VideoSink& video, class DesktopWindow& window)
+		: mBus(), mCPU(mBus), mPPU(mBus, &video), mAPU(mBus), mController(mBus), mpCartridge(LoadRom(romFileName)), mKeyboard(window)
 	{
 		mBus.mpCartridge = mpCartridge.get();
 		mBus.mpCPU = &mCPU;
 		mBus.mpPPU = &mPPU;
 		mBus.mpAPU = &mAPU;
 		mBus.mpController = &mController;
+		mController.SetInputSource(&mKeyboard);
+		mBus.SetMirroring(mpCartridge->GetMirroring());
 		mCPU.Reset();
 	}
 
@@ -28,14 +32,52 @@ public:
 
 		for (; dt > 0; dt -= 0.00000056f)
 		{
-			//Poll user input
-			mController.Execute();
-			mCPU.Execute();
-			//3 PPU clock cycles = 1 CPU clock cycle
-			mPPU.Execute();
-			mPPU.Execute();
-			mPPU.Execute();
+			Clock();
 		}
+		PumpAudio();
+	}
+
+	//Run as fast as possible until the given number of frames have been completed, for fast forward and headless runs
+	void RunFrames(unsigned int frames)
+	{
+		const ubyte8 targetFrame = mPPU.GetFrameCount() + frames;
+		for (ubyte8 frame = mPPU.GetFrameCount(); frame < targetFrame; frame = mPPU.GetFrameCount())
+		{
+			while (mPPU.GetFrameCount() == frame)
+				Clock();
+			PumpAudio();
+		}
+	}
+
+	//Audio paced mode, run one frame and then sleep until the backend has played the stream down to its latency target
+	//The sound card is the only clock then, so there is no drift to correct and the stream needs no rate control
+	void RunFramePacedByAudio()
+	{
+		RunFrames(1u);
+		if (pAudio != nullptr)
+			pAudio->WaitForFill(pAudio->GetLatencySamples());
+	}
+
+	//Stream finished APU samples to an audio backend, nullptr to stop, the stream has to use the APU's sample rate
+	//With a rate control the APU's resampling ratio follows the stream's fill level once per frame, for when Run isn't clocked by the sound card
+	void SetAudioStream(AudioStream* stream, AudioRateControl* rateControl = nullptr)
+	{
+		pAudio = stream;
+		pRateControl = rateControl;
+		if (pRateControl == nullptr)
+			mAPU.SetRateAdjust(1.0);
+	}
+
+	//Where the controllers get their buttons from, nullptr goes back to the window's keyboard
+	void SetInputSource(InputSource* source)
+	{
+		mController.SetInputSource(source != nullptr ? source : &mKeyboard);
+	}
+
+	//Only draw every (skip + 1)th frame, see PPU_2C02::SetFrameSkip
+	void SetFrameSkip(unsigned int skip)
+	{
+		mPPU.SetFrameSkip(skip);
 	}
 
 	BUS mBus;
@@ -45,39 +87,44 @@ public:
 	Controller mController;
 	std::unique_ptr<Mapper> mpCartridge;//NES Cartridge
 private:
+	AudioStream* pAudio = nullptr;
+	AudioRateControl* pRateControl = nullptr;
+	ubyte8 mRateControlFrame = 0;
+	KeyboardInput mKeyboard;
 
-	std::unique_ptr<Mapper> LoadRom(std::string filename)
+	//Move every sample the APU has finished into the audio stream
+	void PumpAudio()
 	{
-		Header header;
-
-		std::ifstream file(filename, std::ifstream::binary);
-		file.exceptions(std::ifstream::badbit | std::ifstream::failbit);
-
-		file.read(reinterpret_cast<char*>(&header), 16);
+		if (pAudio == nullptr)
+			return;
 
-		//------------TODO: Do stuff with trainer if present
+		float samples[1024u];
+		while (size_t count = mAPU.ReadSamples(samples, std::size(samples)))
+			pAudio->Write(samples, count);
 
-		ubyte mapperNum = (header.flags7 & 0xf0u) | (header.flags6 >> 4u);
-		assert(mapperNum == 0);
-
-		if (IsBitOn<0>(header.flags6))
-		{
-			//Horizontal arrangement
-			mBus.Mirror = [](ubyte2 address) {return address % 0x800u; };
-			mPPU.nextNametableOffset = 0x400u;
-		}
-		else
+		if (pRateControl != nullptr && mPPU.GetFrameCount() != mRateControlFrame)
 		{
-			//Vertical Arrrangement
-			mBus.Mirror = [](ubyte2 address) { return 0x400 * (address >= 0x2800u) + address % 0x400u; };
-			mPPU.nextNametableOffset = 0x800u;
+			mRateControlFrame = mPPU.GetFrameCount();
+			mAPU.SetRateAdjust(pRateControl->Update());
 		}
+	}
 
-		switch (mapperNum)
-		{
-		case 0: return std::make_unique<Mapper0>(header, file);
-			//case 1: mpMapper = std::make_unique<Mapper1>(header, file); break;
-		default: return nullptr;
-		}
+	//Emulate a single CPU clock cycle
+	void Clock()
+	{
+		mCPU.Execute();
+		++mBus.mCPUCycle;
+		//The PPU catches up by itself when its registers are accessed, so it only has to be run here once its next VBLANK/NMI point arrives
+		if (mBus.mCPUCycle * 3u > mPPU.NextEventDot())
+			mPPU.Sync();
+		//Same for the APU's frame counter steps, which can raise the frame IRQ, and its DMC fetches, an event at cycle N runs once cycle N has passed
+		if (mBus.mCPUCycle > mAPU.NextEventCycle())
+			mAPU.Sync();
+	}
+
+	std::unique_ptr<Mapper> LoadRom(std::string filename)
+	{
+		//Battery saves go next to the ROM
+		return Mapper::Create(Rom::Load(filename), std::filesystem::path(filename).replace_extension(".sav"));
 	}
 };
\ No newline at end of file
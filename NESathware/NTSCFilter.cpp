@@ -0,0 +1,141 @@
+#include "NTSCFilter.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+//Voltage levels relative to sync, Source: "https://www.nesdev.org/wiki/NTSC_video#Terminated_measurement"
+static constexpr float signalBlack = 0.518f;
+static constexpr float signalWhite = 1.962f;
+static constexpr float emphasisAttenuation = 0.746f;
+static constexpr float signalLevels[8] =
+{
+	0.350f, 0.518f, 0.962f, 1.550f,//Signal low
+	1.094f, 1.506f, 1.962f, 1.962f//Signal high
+};
+//Lines the decoder's color burst up with the PPU's, in samples
+static constexpr float hueOffset = 3.9f;
+
+NTSCFilter::NTSCFilter()
+	: mKernels(std::make_unique<__m128[]>(numPhases * 3u * numColors * kernelWidth)),
+	mAccumulator(std::make_unique<__m128[]>(accumulatorWidth))
+{
+	//Output pixel r of a group decodes the 12 samples centered on it, a group is 24 samples wide and 7 output pixels wide
+	auto windowStart = [](int r) { return (int)std::floor((r + 0.5f) * 24.0f / 7.0f) - 6; };
+
+	for (unsigned int pixelInGroup = 0; pixelInGroup < 3u; ++pixelInGroup)
+	{
+		const int firstSample = (int)pixelInGroup * 8;
+		int r = -8;
+		while (windowStart(r) + 12 <= firstSample)
+			++r;
+		mKernelStart[pixelInGroup] = r;
+		assert(windowStart(r + (int)kernelWidth) >= firstSample + 8);
+	}
+
+	for (unsigned int phase = 0; phase < numPhases; ++phase)
+	{
+		for (unsigned int pixelInGroup = 0; pixelInGroup < 3u; ++pixelInGroup)
+		{
+			const int firstSample = (int)pixelInGroup * 8;
+			for (unsigned int color = 0; color < numColors; ++color)
+			{
+				__m128* kernel = &mKernels[((phase * 3u + pixelInGroup) * numColors + color) * kernelWidth];
+				for (unsigned int slot = 0; slot < kernelWidth; ++slot)
+				{
+					const int start = windowStart(mKernelStart[pixelInGroup] + (int)slot);
+					float y = 0.0f, i = 0.0f, q = 0.0f;
+					for (int sample = std::max(start, firstSample); sample < std::min(start + 12, firstSample + 8); ++sample)
+					{
+						const unsigned int samplePhase = phase * 4u + (unsigned int)sample;
+						const float level = Signal(color, samplePhase % 12u) / 12.0f;
+						const float angle = float(std::numbers::pi) * (samplePhase + hueOffset) / 6.0f;
+						y += level;
+						//Demodulating a sine halves it, so chroma is doubled back
+						i += 2.0f * level * std::cos(angle);
+						q += 2.0f * level * std::sin(angle);
+					}
+
+					//YIQ to RGB, Source: "https://en.wikipedia.org/wiki/YIQ#Preconditioning"
+					kernel[slot] = _mm_setr_ps(
+						y + 0.946882f * i + 0.623557f * q,
+						y - 0.274788f * i - 0.635691f * q,
+						y - 1.108545f * i + 1.709007f * q,
+						0.0f);
+				}
+			}
+		}
+	}
+}
+
+float NTSCFilter::Signal(unsigned int color, unsigned int phase)
+{
+	const unsigned int hue = color & 0x0fu;
+	unsigned int level = (color >> 4u) & 0x03u;
+	const unsigned int emphasis = color >> 6u;
+	//Colors $xE and $xF are forced to level 1
+	if (hue > 13u)
+		level = 1u;
+
+	float low = signalLevels[level];
+	float high = signalLevels[4u + level];
+	//Hue 0 is only the high level, hues 13 - 15 only the low level
+	if (hue == 0)
+		low = high;
+	if (hue > 12u)
+		high = low;
+
+	auto inColorPhase = [phase](unsigned int hue) { return (hue + phase) % 12u < 6u; };
+	float signal = inColorPhase(hue) ? high : low;
+	//Each emphasis bit attenuates the signal during a third of the color cycle
+	if ((IsBitOn(0, (ubyte)emphasis) && inColorPhase(0)) ||
+		(IsBitOn(1, (ubyte)emphasis) && inColorPhase(4)) ||
+		(IsBitOn(2, (ubyte)emphasis) && inColorPhase(8)))
+		signal *= emphasisAttenuation;
+
+	return (signal - signalBlack) / (signalWhite - signalBlack);
+}
+
+void NTSCFilter::Filter(const ubyte* frameIndices, const ubyte* lineEmphasis, Color* out)
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128i alpha = _mm_set1_epi32((int)0xff000000);
+
+	for (unsigned int scanline = 0; scanline < height; ++scanline)
+	{
+		const unsigned int phase = (mFramePhase + scanline) % numPhases;
+		const unsigned int emphasis = (unsigned int)(lineEmphasis[scanline] & 0x07u) << 6u;
+		const ubyte* indexes = &frameIndices[scanline * inputWidth];
+
+		memset(mAccumulator.get(), 0, accumulatorWidth * sizeof(__m128));
+		for (unsigned int x = 0; x < inputWidth; ++x)
+		{
+			const unsigned int pixelInGroup = x % 3u;
+			const __m128* kernel = Kernel(phase, pixelInGroup, emphasis | (indexes[x] & 0x3fu));
+			__m128* accumulator = &mAccumulator[accumulatorOffset + (x / 3u) * 7u + mKernelStart[pixelInGroup]];
+			for (unsigned int slot = 0; slot < kernelWidth; ++slot)
+				accumulator[slot] = _mm_add_ps(accumulator[slot], kernel[slot]);
+		}
+
+		//Clamp to 0 - 1 and pack 4 pixels at a time into bytes, the last group of 4 is only partly in the image
+		const __m128* line = &mAccumulator[accumulatorOffset];
+		Color* outRow = &out[scanline * outputWidth];
+		for (unsigned int x = 0; x < outputWidth; x += 4u)
+		{
+			__m128i pixels[4];
+			for (unsigned int i = 0; i < 4u; ++i)
+				pixels[i] = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(line[x + i], scale), zero), scale));
+			const __m128i packed = _mm_or_si128(_mm_packus_epi16(_mm_packs_epi32(pixels[0], pixels[1]), _mm_packs_epi32(pixels[2], pixels[3])), alpha);
+
+			if (x + 4u <= outputWidth)
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&outRow[x]), packed);
+			else
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(&outRow[x]), packed);
+		}
+	}
+
+	mFramePhase = (mFramePhase + 1u) % numPhases;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "CommonTypes.h"
+#include "../SathwareEngine/Color.h"
+#include <xmmintrin.h>
+#include <memory>
+
+//Simulates the NES composite video signal to get NTSC color artifacts, Source: "https://www.nesdev.org/wiki/NTSC_video"
+//Every PPU pixel is 8 samples of a square wave, 12 samples per color cycle, which a TV decodes back to YIQ over a 12 sample window
+//Decoding is linear, so the RGB that every pixel adds to the output pixels around it is precomputed per color and phase and a frame is just a sum of kernels
+class NTSCFilter
+{
+public:
+	//3 PPU pixels (24 samples, 2 color cycles) become 7 output pixels, Source: "http://slack.net/~ant/libs/ntsc.html"
+	static constexpr unsigned int inputWidth = 256u;
+	static constexpr unsigned int outputWidth = 602u;
+	static constexpr unsigned int height = 240u;
+
+	NTSCFilter();
+	//frameIndices are 256x240 system palette indexes, lineEmphasis the PPUMASK emphasis bits (0 - 7) of every scanline
+	//out must hold outputWidth * height colors
+	void Filter(const ubyte* frameIndices, const ubyte* lineEmphasis, Color* out);
+private:
+	//The color subcarrier moves 4 samples every scanline, so there are 3 scanline phases
+	static constexpr unsigned int numPhases = 3u;
+	//Most output pixels one input pixel reaches
+	static constexpr unsigned int kernelWidth = 6u;
+	//Input pixels and the emphasis bits above them, (emphasis << 6) | index
+	static constexpr unsigned int numColors = 512u;
+	//Left edge pixels reach 1 output pixel to the left of the image, the rest pads the right edge
+	static constexpr unsigned int accumulatorOffset = 1u;
+	static constexpr unsigned int accumulatorWidth = outputWidth + 8u;
+
+	//Signal level of a color at a sample phase, 0 = black and 1 = white
+	static float Signal(unsigned int color, unsigned int phase);
+	const __m128* Kernel(unsigned int phase, unsigned int pixelInGroup, unsigned int color) const
+	{
+		return &mKernels[((phase * 3u + pixelInGroup) * numColors + color) * kernelWidth];
+	}
+
+	//RGB (and an unused 4th lane) each input pixel adds to kernelWidth output pixels, by scanline phase, position within a group of 3 and color
+	std::unique_ptr<__m128[]> mKernels;
+	//First output pixel each position within a group of 3 reaches, relative to the group's first output pixel
+	int mKernelStart[3] = {};
+	//Output of the scanline being filtered
+	std::unique_ptr<__m128[]> mAccumulator;
+	//Phase of the first scanline, changes every frame like on hardware so the artifacts don't stay still
+	unsigned int mFramePhase = 0;
+};
@@ -0,0 +1,281 @@
+#include "PPURenderer.h"
+#include <cstring>
+
+PPURenderer::PPURenderer(std::function<void(const PPUFrameRecord&)> onFrameComplete)
+	: OnFrameComplete(std::move(onFrameComplete)), mRecords(std::make_unique<PPUFrameRecord[]>(numRecords)),
+	mVerifyFrameIndices(std::make_unique<ubyte[]>(256u * 240u))
+{
+	for (unsigned int i = 0; i < numRecords; ++i)
+		mFreeRecords.push_back(&mRecords[i]);
+}
+
+PPURenderer::~PPURenderer()
+{
+	StopThread();
+}
+
+void PPURenderer::StartThread()
+{
+	if (IsThreaded())
+		return;
+
+	mThreadRunning = true;
+	mThread = std::thread(&PPURenderer::RenderThread, this);
+}
+
+void PPURenderer::StopThread()
+{
+	if (!IsThreaded())
+		return;
+
+	mThreadRunning = false;
+	++mSubmitCount;
+	mSubmitCount.notify_one();
+	mThread.join();
+
+	//Draw whatever the thread left behind so no record is lost
+	PPUFrameRecord* record;
+	while (mPendingRecords.Pop(record))
+	{
+		Rasterize(*record, record->FrameIndices, record->LineEmphasis);
+		OnFrameComplete(*record);
+		mCompletedRecords.Push(record);
+	}
+	CollectCompletedFrames();
+}
+
+PPUFrameRecord* PPURenderer::AcquireRecord()
+{
+	CollectCompletedFrames();
+	//Every record is queued or being drawn, wait for the render thread to hand one back
+	while (mFreeRecords.empty())
+	{
+		std::this_thread::yield();
+		CollectCompletedFrames();
+	}
+
+	PPUFrameRecord* record = mFreeRecords.back();
+	mFreeRecords.pop_back();
+	record->Writes.clear();
+	return record;
+}
+
+void PPURenderer::Submit(PPUFrameRecord* record)
+{
+	if (IsThreaded())
+	{
+		//There are only numRecords records so the queue always has room
+		mPendingRecords.Push(record);
+		++mSubmitCount;
+		mSubmitCount.notify_one();
+		return;
+	}
+
+	Rasterize(*record, record->FrameIndices, record->LineEmphasis);
+	OnFrameComplete(*record);
+	mCompletedRecords.Push(record);
+	CollectCompletedFrames();
+}
+
+void PPURenderer::RenderThread()
+{
+	while (mThreadRunning)
+	{
+		const unsigned int submitCount = mSubmitCount.load();
+		PPUFrameRecord* record;
+		if (!mPendingRecords.Pop(record))
+		{
+			//Sleep until the emulation thread submits something
+			mSubmitCount.wait(submitCount);
+			continue;
+		}
+
+		Rasterize(*record, record->FrameIndices, record->LineEmphasis);
+		OnFrameComplete(*record);
+		mCompletedRecords.Push(record);
+	}
+}
+
+void PPURenderer::CollectCompletedFrames()
+{
+	PPUFrameRecord* record;
+	while (mCompletedRecords.Pop(record))
+	{
+		//Determinism check, drawing the same record again on this thread has to give the exact same frame
+		if (mVerifyThreadOutput && IsThreaded())
+		{
+			Rasterize(*record, mVerifyFrameIndices.get(), nullptr);
+			if (memcmp(mVerifyFrameIndices.get(), record->FrameIndices, 256u * 240u) != 0)
+				++mVerifyMismatches;
+		}
+
+		if (mpLastFrame != nullptr)
+			mFreeRecords.push_back(mpLastFrame);
+		mpLastFrame = record;
+	}
+}
+
+void PPURenderer::Rasterize(const PPUFrameRecord& record, ubyte* frameIndices, ubyte* lineEmphasis)
+{
+	//Writes are applied to a copy as the frame is drawn so the record stays untouched
+	PPUMemory memory = record.Memory;
+	ScanlineSprites scanlineSprites[240u];
+	unsigned int spriteHeight = IsBitOn<5>(record.Registers[0].PPUCTRL) ? 16u : 8u;
+	EvaluateSprites(memory.OAM, spriteHeight, scanlineSprites);
+
+	size_t nextWrite = 0;
+	for (unsigned int scanline = 0; scanline < 240u; ++scanline)
+	{
+		//Writes made during the previous scanlines show up from this scanline onwards
+		bool oamChanged = false;
+		for (; nextWrite < record.Writes.size() && record.Writes[nextWrite].ScanLine < scanline; ++nextWrite)
+		{
+			const PPUMemoryWrite& write = record.Writes[nextWrite];
+			if (write.IsOAM)
+			{
+				memory.OAM[write.Address % 256u] = write.Value;
+				oamChanged = true;
+			}
+			else
+				memory.Write(write.Value, write.Address);
+		}
+		if (oamChanged)
+			EvaluateSprites(memory.OAM, spriteHeight, scanlineSprites);
+
+		const ScanlineRegisters& registers = record.Registers[scanline];
+		RasterizeScanLine(memory, registers, record.NextNametableOffset, scanline, scanlineSprites[scanline], &frameIndices[scanline * 256u]);
+		//Bits 5 - 7 of PPUMASK are the color emphasis bits
+		if (lineEmphasis != nullptr)
+			lineEmphasis[scanline] = registers.PPUMASK >> 5u;
+	}
+}
+
+void PPURenderer::RasterizeScanLine(const PPUMemory& memory, const ScanlineRegisters& registers, ubyte2 nextNametableOffset,
+	unsigned int scanline, const ScanlineSprites& lineSprites, ubyte* lineIndices)
+{
+	//A subpalette is 4 bytes long, and houses indexes into the system palette
+	//ColorIndexes[0] = background color index, ColorIndexes[1 to 3] = color indexes
+	const ubyte* const backgroundPalettes = memory.PaletteRAM;
+	//Sprite sub palettes start at 16 bytes into palette ram
+	const ubyte* const spritePalettes = &memory.PaletteRAM[16u];
+
+	//One bit per pixel, set where the background pixel is opaque, used for sprite priority
+	ubyte8 backgroundOpacity[4u] = { 0 };
+	for (unsigned int scanCol = 0; scanCol < 256u; ++scanCol)
+	{
+		const ubyte pixel = BackgroundPixel(memory, registers, nextNametableOffset, scanCol, scanline);
+		const ubyte subPaletteColorIndex = pixel & 0x03u;
+		//background color indexes in subpalette are mirrors of background index in subpalette 0
+		if (subPaletteColorIndex == 0)
+			lineIndices[scanCol] = backgroundPalettes[0];
+		else
+		{
+			lineIndices[scanCol] = backgroundPalettes[(pixel >> 2u) * 4u + subPaletteColorIndex];
+			backgroundOpacity[scanCol / 64u] |= 1ull << (scanCol % 64u);
+		}
+	}
+
+	const Sprite* const sprites = reinterpret_cast<const Sprite*>(memory.OAM);
+	//One bit per pixel, set once a sprite in front has claimed the pixel
+	ubyte8 spriteOpacity[4u] = { 0 };
+	for (unsigned int n = 0; n < lineSprites.Count; ++n)
+	{
+		const Sprite& sprite = sprites[lineSprites.OAMIndexes[n]];
+
+		//flip horizontally flag
+		const bool hFlip = IsBitOn<6>(sprite.Attributes);
+		//behind background flag
+		const bool behindBackground = IsBitOn<5>(sprite.Attributes);
+
+		const ubyte2 rowAddress = SpriteRowAddress(sprite, registers.PPUCTRL, scanline);
+		const ubyte patternLow = memory.Read(rowAddress);
+		const ubyte patternHigh = memory.Read(rowAddress + 8u);
+
+		//bits 0-1 of sprite attributes contain sub palette index
+		const ubyte* const subPalette = &spritePalettes[(sprite.Attributes & 0x03u) * 4u];
+
+		for (unsigned int tileCol = 0; tileCol < 8u; ++tileCol)
+		{
+			//Sprites hanging off the right edge are clipped instead of skipped
+			const unsigned int x = sprite.PosXLeft + tileCol;
+			if (x > 255u)
+				break;
+
+			const unsigned int bit = hFlip ? tileCol : 7u - tileCol;
+			ubyte subPaletteColorIndex = ((ubyte)IsBitOn(bit, patternHigh) << 1u) | (ubyte)IsBitOn(bit, patternLow);
+			//transparent pixel, or a sprite earlier in OAM already owns this pixel
+			const ubyte8 pixelMask = 1ull << (x % 64u);
+			if (subPaletteColorIndex == 0 || (spriteOpacity[x / 64u] & pixelMask))
+				continue;
+			spriteOpacity[x / 64u] |= pixelMask;
+
+			const bool backgroundOpaque = (backgroundOpacity[x / 64u] & pixelMask) != 0;
+			if (!behindBackground || !backgroundOpaque)
+				lineIndices[x] = subPalette[subPaletteColorIndex];
+		}
+	}
+
+	//Bit 0 of PPUMASK forces greyscale by only keeping the brightness column of the system palette
+	if (IsBitOn<0>(registers.PPUMASK))
+	{
+		for (unsigned int scanCol = 0; scanCol < 256u; ++scanCol)
+			lineIndices[scanCol] &= 0x30u;
+	}
+}
+
+void PPURenderer::EvaluateSprites(const ubyte* oam, unsigned int spriteHeight, ScanlineSprites* scanlineSprites)
+{
+	//OAM data as Sprite array
+	const Sprite* const sprites = reinterpret_cast<const Sprite*>(oam);
+
+	for (unsigned int scanline = 0; scanline < 240u; ++scanline)
+	{
+		scanlineSprites[scanline].Count = 0;
+		scanlineSprites[scanline].Overflow = false;
+	}
+
+	//Walking OAM in order keeps every scanline list sorted front to back
+	for (unsigned int i = 0; i < 64u; ++i)
+	{
+		//Sprite data is delayed by one scanline, so a sprite is drawn starting from the scanline after PosYTop
+		const unsigned int top = sprites[i].PosYTop + 1u;
+		for (unsigned int scanline = top; scanline < top + spriteHeight && scanline < 240u; ++scanline)
+		{
+			ScanlineSprites& lineSprites = scanlineSprites[scanline];
+			//The PPU only has room for 8 sprites per scanline, the rest are dropped
+			if (lineSprites.Count == 8u)
+			{
+				lineSprites.Overflow = true;
+				continue;
+			}
+			lineSprites.OAMIndexes[lineSprites.Count++] = (ubyte)i;
+		}
+	}
+}
+
+ubyte2 PPURenderer::SpriteRowAddress(const Sprite& sprite, ubyte PPUCTRL, unsigned int scanline)
+{
+	const unsigned int height = IsBitOn<5>(PPUCTRL) ? 16u : 8u;
+	//flip vertically flag
+	const bool vFlip = IsBitOn<7>(sprite.Attributes);
+
+	unsigned int spriteRow = (scanline - (sprite.PosYTop + 1u)) % height;
+	if (vFlip)
+		spriteRow = height - 1u - spriteRow;
+
+	ubyte2 tileAddress;
+	if (height == 16u)
+	{
+		//8x16 sprites use bit 0 for the pattern table and the rest for the top tile, the bottom tile is the next tile
+		ubyte2 tileIndex = (sprite.TileIndex & 0xfeu) + (spriteRow / 8u);
+		tileAddress = (sprite.TileIndex & 0x01u) * 0x1000u + tileIndex * 16u;
+	}
+	else
+	{
+		//Bit 3 of PPUCTRL gives the base pattern table address for 8x8 sprites
+		const ubyte2 basePatternTableAddress = IsBitOn<3>(PPUCTRL) * 0x1000;
+		tileAddress = basePatternTableAddress + sprite.TileIndex * 16u;
+	}
+
+	return tileAddress + spriteRow % 8u;
+}
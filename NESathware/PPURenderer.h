@@ -0,0 +1,225 @@
+#pragma once
+#include "CommonTypes.h"
+#include "../SathwareEngine/SPSCQueue.h"
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+//The OAM contains sprite data, 4 bytes per sprite, that describe the (x, y) position and pattern tile index and other flags
+struct Sprite
+{
+	ubyte PosYTop;
+	ubyte TileIndex;
+	ubyte Attributes;
+	ubyte PosXLeft;
+};
+
+//Sprites found on a single scanline during sprite evaluation, in OAM order (i.e. front to back)
+struct ScanlineSprites
+{
+	ubyte Count;
+	//More than 8 sprites landed on this scanline
+	bool Overflow;
+	ubyte OAMIndexes[8u];
+};
+
+//PPU registers that affect rendering, captured at the start of every visible scanline
+struct ScanlineRegisters
+{
+	ubyte PPUCTRL;
+	ubyte PPUMASK;
+	ubyte XScroll;
+	ubyte YScroll;
+};
+
+//A write to PPU memory or OAM made by the CPU while a frame was being drawn
+struct PPUMemoryWrite
+{
+	//Scanline the PPU was on when the write happened, the write is visible from the next scanline onwards
+	ubyte ScanLine;
+	bool IsOAM;
+	ubyte2 Address;
+	ubyte Value;
+};
+
+//Copy of all the memory the PPU reads while rendering
+struct PPUMemory
+{
+	ubyte PatternTables[0x2000u];
+	ubyte VRAM[0x0800u];
+	//1KB page of VRAM that each of the 4 nametables is mirrored to
+	ubyte NametablePages[4u];
+	ubyte PaletteRAM[32u];
+	ubyte OAM[256u];
+
+	//Same address space as BUS::ReadPPU plus palette RAM
+	ubyte Read(ubyte2 address) const
+	{
+		address %= 0x4000u;
+		if (address < 0x2000u)
+			return PatternTables[address];
+		else if (address < 0x3f00u)
+			return VRAM[NametablePages[(address >> 10u) & 0x03u] * 0x400u + (address & 0x3ffu)];
+		else
+			return PaletteRAM[address % 0x0020u];
+	}
+
+	void Write(ubyte val, ubyte2 address)
+	{
+		address %= 0x4000u;
+		if (address < 0x2000u)
+			PatternTables[address] = val;
+		else if (address < 0x3f00u)
+			VRAM[NametablePages[(address >> 10u) & 0x03u] * 0x400u + (address & 0x3ffu)] = val;
+		else
+			PaletteRAM[address % 0x0020u] = val;
+	}
+};
+
+//Everything the emulation thread records about a frame, and the frame drawn from it
+struct PPUFrameRecord
+{
+	//PPU memory at the start of scanline 0
+	PPUMemory Memory;
+	ubyte2 NextNametableOffset;
+	ScanlineRegisters Registers[240u];
+	//Writes made during the frame, in order
+	std::vector<PPUMemoryWrite> Writes;
+	//Present the frame through the NTSC filter, travels with the frame so only the presenting thread touches the filter
+	bool UseNTSCFilter;
+
+	//Output, 256x240 system palette indexes and the emphasis bits of each scanline
+	ubyte FrameIndices[256u * 240u];
+	ubyte LineEmphasis[240u];
+};
+
+//Draws frames from PPUFrameRecords, either inline on the emulation thread or on its own render thread
+//Both paths run the same Rasterize, so output is identical whichever is used
+class PPURenderer
+{
+public:
+	//onFrameComplete is called with every drawn frame, from the render thread when it is running
+	PPURenderer(std::function<void(const PPUFrameRecord&)> onFrameComplete);
+	~PPURenderer();
+
+	void StartThread();
+	void StopThread();
+	bool IsThreaded() const
+	{
+		return mThread.joinable();
+	}
+	//Re-draw every frame coming back from the render thread on the emulation thread and compare the results
+	void SetVerifyThreadOutput(bool verify)
+	{
+		mVerifyThreadOutput = verify;
+	}
+	//Number of frames where the render thread and the emulation thread disagreed
+	unsigned int GetVerifyMismatches() const
+	{
+		return mVerifyMismatches;
+	}
+
+	//Emulation thread only, get an unused record to fill for the next frame, waits if all records are in flight
+	PPUFrameRecord* AcquireRecord();
+	//Emulation thread only, draw a filled record
+	void Submit(PPUFrameRecord* record);
+	//Emulation thread only, the newest frame that finished drawing
+	const PPUFrameRecord* GetLastFrame() const
+	{
+		return mpLastFrame;
+	}
+
+	/* Rendering */
+	//Draw a frame, only reads record so it is safe to run on any thread
+	static void Rasterize(const PPUFrameRecord& record, ubyte* frameIndices, ubyte* lineEmphasis);
+	//Walk OAM once and bucket up to 8 sprites per scanline, Source: "https://www.nesdev.org/wiki/PPU_sprite_evaluation"
+	static void EvaluateSprites(const ubyte* oam, unsigned int spriteHeight, ScanlineSprites* scanlineSprites);
+	//Address of the low pattern byte of the row of sprite that lands on scanline, handles vertical flip and 8x16 sprites
+	static ubyte2 SpriteRowAddress(const Sprite& sprite, ubyte PPUCTRL, unsigned int scanline);
+	//Returns the background pixel at a screen position, pattern color (0 = transparent) in bits 0-1 and sub palette index in bits 2-3
+	//Memory is anything with a Read(ubyte2 address) in the PPU address space
+	//Background Info: "https://austinmorlan.com/posts/nes_rendering_overview/", "https://www.nesdev.org/wiki/Blargg_PPU", "https://www.nesdev.org/wiki/PPU_nametables", "https://www.nesdev.org/wiki/PPU_pattern_tables"
+	template <typename Memory>
+	static ubyte BackgroundPixel(const Memory& memory, const ScanlineRegisters& registers, ubyte2 nextNametableOffset, unsigned int scanCol, unsigned int scanline);
+private:
+	//Draw one scanline, Sprites Source: "https://famicom.party/book/10-spritegraphics/", "https://www.nesdev.org/wiki/PPU_OAM"
+	static void RasterizeScanLine(const PPUMemory& memory, const ScanlineRegisters& registers, ubyte2 nextNametableOffset,
+		unsigned int scanline, const ScanlineSprites& lineSprites, ubyte* lineIndices);
+	void RenderThread();
+	//Take back frames finished by the render thread
+	void CollectCompletedFrames();
+
+	std::function<void(const PPUFrameRecord&)> OnFrameComplete;
+
+	//Records are owned here and cycle between the free list, the render thread and mpLastFrame
+	static constexpr unsigned int numRecords = 4u;
+	std::unique_ptr<PPUFrameRecord[]> mRecords;
+	std::vector<PPUFrameRecord*> mFreeRecords;
+	PPUFrameRecord* mpLastFrame = nullptr;
+	//Emulation thread -> render thread
+	SPSCQueue<PPUFrameRecord*, 4u> mPendingRecords;
+	//Render thread -> emulation thread
+	SPSCQueue<PPUFrameRecord*, 4u> mCompletedRecords;
+
+	std::thread mThread;
+	std::atomic<bool> mThreadRunning = false;
+	//Bumped on every submit so the render thread can sleep on it
+	std::atomic<unsigned int> mSubmitCount = 0;
+
+	bool mVerifyThreadOutput = false;
+	unsigned int mVerifyMismatches = 0;
+	std::unique_ptr<ubyte[]> mVerifyFrameIndices;
+};
+
+template <typename Memory>
+ubyte PPURenderer::BackgroundPixel(const Memory& memory, const ScanlineRegisters& registers, ubyte2 nextNametableOffset, unsigned int scanCol, unsigned int scanline)
+{
+	//Bit 4 of PPUCTRL register gives the base pattern table address for background
+	ubyte2 basePatternTableAddress = IsBitOn<4>(registers.PPUCTRL) * 0x1000u;
+
+	unsigned int y = scanline + registers.YScroll;
+	unsigned int x = scanCol + registers.XScroll;
+
+	//Bits 0 - 1 of PPUCTRL register gives the base nametable address
+	ubyte2 baseNametableAddress = 0x2000u + 0x0400u * (registers.PPUCTRL & 0x03u);
+	//Map screen coordinates (0 - 255, 0 - 239) to nametable coordinates (0 - 31, 0 - 29)
+	ubyte2 nametableIndex = ((y / 8u) * 32u) + (x / 8u);
+	//PPU scrolling
+	if (nametableIndex >= 0x3c0u)
+	{
+		//Go to next nametable
+		baseNametableAddress = (baseNametableAddress + nextNametableOffset) % 0x1000u + 0x2000u;
+		nametableIndex %= 0x3c0u;
+		y %= 240u;
+		x %= 256u;
+	}
+
+	//Each nametable is 1024 bytes, and a nametable's attribute table sits at the last 64 bits
+	ubyte2 attributeTableStart = baseNametableAddress + 0x3c0u;
+
+	//Each nametable entry is 1 byte, so the address of the pattern table index is base + nametableindex * sizeof(byte)
+	ubyte2 patternTableIndex = memory.Read(baseNametableAddress + nametableIndex);
+
+	//Each pattern table entry (i.e. bitplane) is 16 bytes, so the address of the pattern bit plane is base + index * sizeof(bitplane)
+	//The address of the low pattern byte is (bit plane address) + (tile row)
+	//The address of the high pattern byte is (address of the low pattern byte) + 8
+	ubyte2 tileRow = y % 8u;
+	ubyte patternLow = memory.Read(basePatternTableAddress + patternTableIndex * 16u + tileRow);
+	ubyte patternHigh = memory.Read(basePatternTableAddress + patternTableIndex * 16u + tileRow + 8u);
+
+
+	ubyte2 attributeTableIndex = ((y / 32u) * 8u) + (x / 32u);
+	//Each entry stores palette data about a 4x4 tile area, each quadrant is 2x2 tiles
+	//bits 0-1 => topleft quadrant, bits 2-3 topright quadrant, bits 4-5 => bottomleft quadrant, bits 6-7 => bottomright quadrant
+	ubyte palette4x4Tiles = memory.Read(attributeTableStart + attributeTableIndex);
+	//0b00 = topleft, 0b01 = topright, 0b10 = bottomleft, 0b11 = bottomright
+	ubyte quadrant = (((y / 16u) % 2u) << 1u) | (x / 16u) % 2u;
+	//Calculate mPaletteRam index by getting appropriate quadrant values from attribute table data (i.e. palette4x4tiles)
+	ubyte subPaletteIndex = (palette4x4Tiles >> (quadrant * 2u)) & (0x03);
+
+	ubyte2 tileCol = x % 8u;
+	ubyte subPaletteColorIndex = ((ubyte)IsBitOn(7 - tileCol, patternHigh) << 1u) | (ubyte)IsBitOn(7 - tileCol, patternLow);
+	return (subPaletteIndex << 2u) | subPaletteColorIndex;
+}
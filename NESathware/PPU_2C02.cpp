@@ -1,34 +1,223 @@
 #include "PPU_2C02.h"
 #include "BUS.h"
+#include <algorithm>
+#include <bit>
 
-PPU_2C02::PPU_2C02(BUS& bus, Graphics& gfx)
-	: Bus(bus), gfx(gfx)
-{}
+PPU_2C02::PPU_2C02(BUS& bus, VideoSink* video)
+	: Bus(bus), pVideo(video), mRenderer([this](const PPUFrameRecord& frame) { PresentFrame(frame); })
+{
+	//Emphasis darkens the color channels that are not emphasized, Source: "https://www.nesdev.org/wiki/NTSC_video#Color_Tint_Bits"
+	for (unsigned int emphasis = 0; emphasis < 8u; ++emphasis)
+	{
+		for (unsigned int i = 0; i < 64u; ++i)
+		{
+			const ubyte* rgba = reinterpret_cast<const ubyte*>(&mSystemPalette[i].rgba);
+			ubyte channels[3];
+			for (unsigned int channel = 0; channel < 3u; ++channel)
+			{
+				const bool attenuate = (emphasis & ~(1u << channel)) != 0;
+				channels[channel] = attenuate ? (ubyte)(rgba[channel] * 3u / 4u) : rgba[channel];
+			}
+			mEmphasisPalettes[emphasis][i] = Color(channels[0], channels[1], channels[2], 0xff);
+		}
+	}
+}
+
+void PPU_2C02::Sync()
+{
+	//3 PPU clock cycles = 1 CPU clock cycle
+	CatchUp(Bus.mCPUCycle * 3u);
+}
 
-void PPU_2C02::Execute()
+void PPU_2C02::CatchUp(ubyte8 targetDot)
 {
-	if (mCurrentScanLine == 240u && mCurrentCycle == 0)
+	while (mSyncedDot < targetDot)
+	{
+		//Scanline events happen on the first cycle, every other cycle of the scanline is skipped over in one step
+		if (mCurrentCycle == 0)
+			StartScanLine();
+
+		//Each scanline has only 340 cycles, it is split where A12 rises when the cartridge counts scanlines
+		const unsigned int riseCycle = A12RiseCycle(mCurrentScanLine);
+		const unsigned int endCycle = mCurrentCycle < riseCycle ? riseCycle : 340u;
+		const ubyte8 step = std::min<ubyte8>(endCycle - mCurrentCycle, targetDot - mSyncedDot);
+		mCurrentCycle += (unsigned int)step;
+		mSyncedDot += step;
+		if (mCurrentCycle == riseCycle)
+			Bus.A12Rise();
+
+		//Every 340 cycles is a new scanline
+		if (mCurrentCycle == 340u)
+		{
+			mCurrentCycle = 0;
+			mCurrentScanLine = (mCurrentScanLine + 1u) % 260u;
+		}
+	}
+
+	ScheduleNextEvent();
+}
+
+void PPU_2C02::ScheduleNextEvent()
+{
+	//Schedule the next VBLANK or pre-render point so the NES only syncs when something visible happens
+	unsigned int eventScanLine;
+	if (mCurrentScanLine < 240u || (mCurrentScanLine == 240u && mCurrentCycle == 0))
+		eventScanLine = 240u;
+	else if (mCurrentScanLine < 259u || (mCurrentScanLine == 259u && mCurrentCycle == 0))
+		eventScanLine = 259u;
+	else
+		eventScanLine = 240u;
+	const unsigned int scanLinesAhead = (eventScanLine + 260u - mCurrentScanLine) % 260u;
+	mNextEventDot = mSyncedDot + (ubyte8)scanLinesAhead * 340u - mCurrentCycle;
+
+	//Scanline counters need the PPU synced at every A12 rise so their IRQ reaches the CPU on time
+	const unsigned int riseCycle = A12RiseCycle(mCurrentScanLine);
+	if (mCurrentCycle < riseCycle)
+		mNextEventDot = std::min(mNextEventDot, mSyncedDot + riseCycle - mCurrentCycle);
+	else if (const unsigned int nextRiseCycle = A12RiseCycle((mCurrentScanLine + 1u) % 260u))
+		mNextEventDot = std::min(mNextEventDot, mSyncedDot + 340u - mCurrentCycle + nextRiseCycle);
+}
+
+unsigned int PPU_2C02::A12RiseCycle(unsigned int scanLine) const
+{
+	//Only the visible and pre-render scanlines fetch patterns, and only while rendering
+	if (!Bus.mpCartridge->CountsScanlines() || (mPPUMASK & 0x18u) == 0 || (scanLine >= 240u && scanLine != 259u))
+		return 0;
+	//A12 is the pattern table half, it rises once when sprite fetches (cycles 257 - 320) and background fetches use different halves
+	//8x16 sprites pick their half per tile, they are taken to be in $1000 like most games put them
+	//Rises between fetches of the same half are too short for the cartridge to see, Source: "https://www.nesdev.org/wiki/MMC3#IRQ_Specifics"
+	const bool backgroundHigh = IsBitOn<4>(mPPUCTRL);
+	const bool spritesHigh = IsBitOn<3>(mPPUCTRL) || IsBitOn<5>(mPPUCTRL);
+	if (backgroundHigh == spritesHigh)
+		return 0;
+	return backgroundHigh ? 324u : 260u;
+}
+
+void PPU_2C02::StartScanLine()
+{
+	if (mCurrentScanLine < 240u)
+	{
+		if (mCurrentScanLine == 0)
+		{
+			PPURenderer::EvaluateSprites(mOAM, spriteHeight(), mScanlineSprites);
+			//Skipped frames still produce sprite 0 hit and sprite overflow, they just aren't recorded or drawn
+			if (mFrameSkip == 0 || (mFrameCount + 1u) % (mFrameSkip + 1u) == 0)
+				BeginFrameRecord();
+		}
+
+		if (mpRecord != nullptr)
+			mpRecord->Registers[mCurrentScanLine] = { mPPUCTRL, mPPUMASK, mXPPUSCROLL, mYPPUSCROLL };
+		UpdateSpriteFlags();
+	}
+	else if (mCurrentScanLine == 240u)
 	{
 		//Create NMI and set VBLANK bit
 		mPPUSTATUS |= 0x80;
 		if (createNMIOnVBLANK())
 			Bus.InvokeNMI();
 
-		RenderBackground();
-		RenderSprites();
-		gfx.Render();
-		gfx.ClearBuffer();
+		++mFrameCount;
+		if (mpRecord != nullptr)
+		{
+			mRenderer.Submit(mpRecord);
+			mpRecord = nullptr;
+		}
+	}
+	else if (mCurrentScanLine == 259u)
+	{
+		//Pre-render scanline clears VBLANK, sprite 0 hit and sprite overflow
+		mPPUSTATUS &= 0x1f;
 	}
+}
+
+void PPU_2C02::BeginFrameRecord()
+{
+	mpRecord = mRenderer.AcquireRecord();
 
-	//Each scanline has only 340 cycles
-	mCurrentCycle = (mCurrentCycle + 1) % 340u;
-	//Every 340 cycles is a new scanline, so a zero cycle marks a new scanline
-	if (mCurrentCycle == 0)
-		mCurrentScanLine = (mCurrentScanLine + 1) % 260u;
+	PPUMemory& memory = mpRecord->Memory;
+	RefreshPatternCache();
+	memcpy(memory.PatternTables, mPatternCache, sizeof(memory.PatternTables));
+	memcpy(memory.VRAM, Bus.mVRAM.data(), sizeof(memory.VRAM));
+	for (unsigned int nametable = 0; nametable < 4u; ++nametable)
+		memory.NametablePages[nametable] = (ubyte)(Bus.Mirror(0x2000u + nametable * 0x400u) / 0x400u);
+	memcpy(memory.PaletteRAM, mPaletteRAM, sizeof(memory.PaletteRAM));
+	memcpy(memory.OAM, mOAM, sizeof(memory.OAM));
+	mpRecord->NextNametableOffset = nextNametableOffset;
+	mpRecord->UseNTSCFilter = mNTSCFilterEnabled;
+}
+
+void PPU_2C02::RefreshPatternCache()
+{
+	const std::array<ubyte8, 8u>& dirtyTiles = Bus.mpCartridge->GetDirtyTiles();
+	unsigned int invalidations = 0;
+	for (unsigned int word = 0; word < 8u; ++word)
+	{
+		for (ubyte8 tiles = dirtyTiles[word]; tiles != 0; tiles &= tiles - 1u)
+		{
+			const ubyte2 start = (ubyte2)((word * 64u + std::countr_zero(tiles)) * 16u);
+			for (ubyte2 address = start; address < start + 16u; ++address)
+				mPatternCache[address] = Read(address);
+			++invalidations;
+		}
+	}
+	Bus.mpCartridge->ClearDirtyTiles();
+	mPatternInvalidations = invalidations;
+}
+
+void PPU_2C02::RecordWrite(bool isOAM, ubyte2 address, ubyte val)
+{
+	if (mpRecord != nullptr)
+		mpRecord->Writes.push_back({ (ubyte)mCurrentScanLine, isOAM, address, val });
+}
+
+void PPU_2C02::UpdateSpriteFlags()
+{
+	//Sprite evaluation only runs while background or sprite rendering is on, and a hit needs both to be drawn
+	//Source: "https://www.nesdev.org/wiki/PPU_sprite_evaluation", "https://www.nesdev.org/wiki/PPU_OAM#Sprite_zero_hits"
+	const bool showBackground = IsBitOn<3>(mPPUMASK);
+	const bool showSprites = IsBitOn<4>(mPPUMASK);
+	if (!showBackground && !showSprites)
+		return;
+
+	const ScanlineSprites& lineSprites = mScanlineSprites[mCurrentScanLine];
+	if (lineSprites.Overflow)
+		mPPUSTATUS |= 0x20;
+
+	//Sprite 0 is always first in the list of a scanline it is on, and only its pixels need testing against the background
+	if (!showBackground || !showSprites || IsBitOn<6>(mPPUSTATUS) || lineSprites.Count == 0 || lineSprites.OAMIndexes[0] != 0)
+		return;
+	//Clipping either layer in the leftmost 8 pixels hides hits there too
+	const unsigned int firstX = IsBitOn<1>(mPPUMASK) && IsBitOn<2>(mPPUMASK) ? 0u : 8u;
+
+	const Sprite& sprite = *reinterpret_cast<const Sprite*>(mOAM);
+	const bool hFlip = IsBitOn<6>(sprite.Attributes);
+	const ubyte2 rowAddress = PPURenderer::SpriteRowAddress(sprite, mPPUCTRL, mCurrentScanLine);
+	const ubyte pattern = Read(rowAddress) | Read(rowAddress + 8u);
+	const ScanlineRegisters registers = { mPPUCTRL, mPPUMASK, mXPPUSCROLL, mYPPUSCROLL };
+
+	for (unsigned int tileCol = 0; tileCol < 8u; ++tileCol)
+	{
+		//Sprite 0 hit never triggers on the last column
+		const unsigned int x = sprite.PosXLeft + tileCol;
+		if (x >= 255u)
+			break;
+		if (x < firstX)
+			continue;
+
+		if (IsBitOn(hFlip ? tileCol : 7u - tileCol, pattern) &&
+			(PPURenderer::BackgroundPixel(LiveMemory{ *this }, registers, nextNametableOffset, x, mCurrentScanLine) & 0x03u) != 0)
+		{
+			mPPUSTATUS |= 0x40;
+			return;
+		}
+	}
 }
 
 ubyte PPU_2C02::ReadRegister(ubyte2 address)
 {
+	//Register reads observe VBLANK and the other status flags, so the PPU has to be up to date first
+	Sync();
+
 	//Convert from CPU Memory address to PPU register index
 	unsigned int regIndex = address % 0x0008;
 
@@ -77,6 +266,8 @@ ubyte PPU_2C02::ReadRegister(ubyte2 address)
 
 void PPU_2C02::WriteRegister(ubyte val, ubyte2 address)
 {
+	Sync();
+
 	//Convert from CPU Memory address to PPU register index
 	unsigned int regIndex = address % 0x0008;
 	//Writing to any register fills the bus latch
@@ -84,11 +275,12 @@ void PPU_2C02::WriteRegister(ubyte val, ubyte2 address)
 
 	switch (regIndex)
 	{
-	case 0/*PPUCTRL*/: { mPPUCTRL = val; return; }
-	case 1/*PPUMASK*/: { mPPUMASK = val; return; }
+	//Both can turn A12 rises on or off
+	case 0/*PPUCTRL*/: { mPPUCTRL = val; ScheduleNextEvent(); return; }
+	case 1/*PPUMASK*/: { mPPUMASK = val; ScheduleNextEvent(); return; }
 	case 2/*PPUSTATUS*/: return;
 	case 3/*OAMADDR*/: { mOAMADDR = val; return; }
-	case 4/*OAMDATA*/: { mOAM[mOAMADDR] = val; ++mOAMADDR; return; }
+	case 4/*OAMDATA*/: { RecordWrite(true, mOAMADDR, val); mOAM[mOAMADDR] = val; ++mOAMADDR; return; }
 	case 5/*PPUSCROLL*/: 
 	{
 		//value being written changes depending on address latch
@@ -112,6 +304,7 @@ void PPU_2C02::WriteRegister(ubyte val, ubyte2 address)
 	case 7/*PPUDATA*/: 
 	{
 		ubyte2 PPUAddress = CombineBytes(mHighPPUADDR, mLowPPUADDR);
+		RecordWrite(false, PPUAddress, val);
 		//Change internal palette or VRAM depending on address
 		if (PPUAddress % 0x4000u >= 0x3f00)
 			//Mirror address down into standard range 0 - 0xfff, then handle palette mirrors
@@ -129,120 +322,86 @@ void PPU_2C02::WriteRegister(ubyte val, ubyte2 address)
 
 void PPU_2C02::WriteOAMDMA(ubyte* data)
 {
+	Sync();
 	memcpy(mOAM, data, 256u);
+	//DMA normally happens during VBLANK, when nothing is being recorded
+	if (mpRecord != nullptr)
+	{
+		for (unsigned int address = 0; address < 256u; ++address)
+			RecordWrite(true, (ubyte2)address, data[address]);
+	}
 }
 
-//Fix attribute table with scrolling
-void PPU_2C02::RenderBackground()
+void PPU_2C02::PatternWindowsChanged(ubyte windows)
 {
-	//Bit 4 of PPUCTRL register gives the base pattern table address for background
-	ubyte2 basePatternTableAddress = IsBitOn<4>(mPPUCTRL) * 0x1000u;
-
-	for (unsigned int scanline = 0; scanline < 240; ++scanline)
+	//The renderer only sees pattern tables through the frame record, so a mid frame bank switch is recorded as writes of every byte it swapped in
+	if (mpRecord == nullptr)
+		return;
+	for (unsigned int window = 0; window < 8u; ++window)
 	{
-		for (unsigned int scanCol = 0; scanCol < 256; ++scanCol)
-		{
-			unsigned int y = scanline + mYPPUSCROLL;
-			unsigned int x = scanCol + mXPPUSCROLL;
-
-			//Bits 0 - 1 of PPUCTRL register gives the base nametable address
-			ubyte2 baseNametableAddress = 0x2000u + 0x0400u * (mPPUCTRL & 0x03u);
-			//Map screen coordinates (0 - 255, 0 - 239) to nametable coordinates (0 - 31, 0 - 29)
-			ubyte2 nametableIndex = ((y / 8u) * 32u) + (x / 8u);
-			//PPU scrolling
-			if (nametableIndex >= 0x3c0u)
-			{
-				//Go to next nametable
-				baseNametableAddress = (baseNametableAddress + nextNametableOffset) % 0x1000u + 0x2000u;
-				nametableIndex %= 0x3c0u;
-				y %= 240u;
-				x %= 256u;
-			}
-
-			//Each nametable is 1024 bytes, and a nametable's attribute table sits at the last 64 bits
-			ubyte2 attributeTableStart = baseNametableAddress + 0x3c0u;
-
-			//Each nametable entry is 1 byte, so the address of the pattern table index is base + nametableindex * sizeof(byte)
-			ubyte2 patternTableIndex = Read(baseNametableAddress + nametableIndex);
-
-			//Each pattern table entry (i.e. bitplane) is 16 bytes, so the address of the pattern bit plane is base + index * sizeof(bitplane)
-			//The address of the low pattern byte is (bit plane address) + (tile row)
-			//The address of the high pattern byte is (address of the low pattern byte) + 8
-			ubyte2 tileRow = y % 8u;
-			ubyte patternLow = Read(basePatternTableAddress + patternTableIndex * 16u + tileRow);
-			ubyte patternHigh = Read(basePatternTableAddress + patternTableIndex * 16u + tileRow + 8u);
+		if (!IsBitOn(window, windows))
+			continue;
+		for (ubyte2 address = (ubyte2)(window * 0x400u); address < (window + 1u) * 0x400u; ++address)
+			RecordWrite(false, address, Read(address));
+	}
+}
 
+void PPU_2C02::PresentFrame(const PPUFrameRecord& frame)
+{
+	//Consumers without a video sink read the frame indexes directly and never pay for the conversion
+	if (pVideo == nullptr)
+		return;
 
-			ubyte2 attributeTableIndex = ((y / 32u) * 8u) + (x / 32u);
-			//Each entry stores palette data about a 4x4 tile area, each quadrant is 2x2 tiles
-			//bits 0-1 => topleft quadrant, bits 2-3 topright quadrant, bits 4-5 => bottomleft quadrant, bits 6-7 => bottomright quadrant
-			ubyte palette4x4Tiles = Read(attributeTableStart + attributeTableIndex);
-			//0b00 = topleft, 0b01 = topright, 0b10 = bottomleft, 0b11 = bottomright
-			ubyte quadrant = (((y / 16u) % 2u) << 1u) | (x / 16u) % 2u;
-			//Calculate mPaletteRam index by getting appropriate quadrant values from attribute table data (i.e. palette4x4tiles)
-			ubyte subPaletteIndex = (palette4x4Tiles >> (quadrant * 2u)) & (0x03);
+	//Sinks that store palette indexes get them before the color conversion
+	if (ubyte* indexes = pVideo->AcquireIndexedFrame())
+		memcpy(indexes, frame.FrameIndices, sizeof(frame.FrameIndices));
+	//The render thread may still be presenting older frames, so the filter only changes with the frame that asked for it
+	if (!frame.UseNTSCFilter)
+		mpNTSCFilter.reset();
+	else if (mpNTSCFilter == nullptr)
+		mpNTSCFilter = std::make_unique<NTSCFilter>();
 
-			SubPalette& subPalette = reinterpret_cast<SubPalette*>(mPaletteRAM)[subPaletteIndex];
+	//Convert straight into the sink's back buffer, publishing never waits on the presenter
+	if (mpNTSCFilter != nullptr)
+		mpNTSCFilter->Filter(frame.FrameIndices, frame.LineEmphasis, pVideo->AcquireFrame());
+	else
+		ConvertFrame(frame, pVideo->AcquireFrame());
+	pVideo->PublishFrame();
+}
 
-			ubyte2 tileCol = x % 8u;
-			ubyte subPaletteColorIndex = ((ubyte)IsBitOn(7 - tileCol, patternHigh) << 1u) | (ubyte)IsBitOn(7 - tileCol, patternLow);
-			//background color indexes in subpalette are mirrors of background index in subpalette 0
-			ubyte systemPaletteIndex = (subPaletteColorIndex == 0) ? mPaletteRAM[0] : subPalette.ColorIndexes[subPaletteColorIndex];
+void PPU_2C02::SetNTSCFilter(bool enabled)
+{
+	if (enabled && (pVideo == nullptr || pVideo->GetWidth() != NTSCFilter::outputWidth || pVideo->GetHeight() != NTSCFilter::height))
+		throw std::runtime_error("The NTSC filter needs a 602x240 video sink");
+	//Takes effect from the next recorded frame, see PresentFrame
+	mNTSCFilterEnabled = enabled;
+}
 
-			gfx.PutPixel(scanCol, scanline, mSystemPalette[systemPaletteIndex]);
-		}
-	}
+void PPU_2C02::ConvertFrame(Color* out) const
+{
+	if (const PPUFrameRecord* frame = mRenderer.GetLastFrame())
+		ConvertFrame(*frame, out);
 }
 
-//TODO - Just display part of sprite that is not overbounds
-void PPU_2C02::RenderSprites()
+void PPU_2C02::ConvertFrame(const PPUFrameRecord& frame, Color* out) const
 {
-	//OAM data as Sprite array
-	const Sprite* const sprites = reinterpret_cast<Sprite*>(&mOAM[mOAMADDR]);
-	//Base pattern table address
-	const ubyte2 basePatternTableAddress = IsBitOn<3>(mPPUCTRL) * 0x1000;
-	//There is a maximum of 64 sprites on the screen
-	for (unsigned int i = 0; i < (64 - mOAMADDR / 4u); ++i)
+	for (unsigned int scanline = 0; scanline < 240u; ++scanline)
 	{
-		//Skip if sprite is overbounds
-		if (sprites[i].PosYTop > 232u || sprites[i].PosXLeft > 248)
-			continue;
-
-		//flip horizontally flag
-		const bool hFlip = IsBitOn<6>(sprites[i].Attributes);
-		//flip vertically flag
-		const bool vFlip = IsBitOn<7>(sprites[i].Attributes);
-
-		//if vFlip is set, tileRow will gor from 7 to 0 else tileCol will go from 0 to 7
-		const int rowEnd = (vFlip ? -1 : 8);
-		const int deltaRow = (vFlip ? -1 : 1);
-		for (int tileRow = (vFlip ? 7 : 0), yOffset = 0; tileRow != rowEnd; tileRow += deltaRow, ++yOffset)
-		{
-			const ubyte patternLow = Read(basePatternTableAddress + sprites[i].TileIndex * 16u + tileRow);
-			const ubyte patternHigh = Read(basePatternTableAddress + sprites[i].TileIndex * 16u + tileRow + 8u);
-			
-			//bits 0-1 of sprite attributes contain sub palette index, and sprite sub palettes start at 16 bytes into palette ram
-			const SubPalette& subPalette = reinterpret_cast<SubPalette*>(&mPaletteRAM[16u])[sprites[i].Attributes & 0x03];
-
-			//if hFlip is set, tileCol will go from 7 to 0 else tileCol will go from 0 to 7
-			const int colEnd = (hFlip ? -1:8);
-			const int deltaCol = (hFlip ? -1:1);
-			for (int tileCol = (hFlip ? 7:0), xOffset = 0; tileCol != colEnd; tileCol += deltaCol, ++xOffset)
-			{
-				ubyte subPaletteColorIndex = ((ubyte)IsBitOn(7 - tileCol, patternHigh) << 1u) | (ubyte)IsBitOn(7 - tileCol, patternLow);
-				//background color indexes in subpalette are mirrors of background index in subpalette 0
-				if (subPaletteColorIndex != 0)
-				{
-					ubyte systemPaletteIndex = subPalette.ColorIndexes[subPaletteColorIndex];
-					gfx.PutPixel(sprites[i].PosXLeft + xOffset, sprites[i].PosYTop + yOffset, mSystemPalette[systemPaletteIndex]);
-				}
-			}
-		}
+		const Color* palette = mEmphasisPalettes[frame.LineEmphasis[scanline]];
+		const ubyte* indexes = &frame.FrameIndices[scanline * 256u];
+		Color* row = &out[scanline * 256u];
+		for (unsigned int x = 0; x < 256u; ++x)
+			row[x] = palette[indexes[x] & 0x3fu];
 	}
 }
 
 void PPU_2C02::DisplayCHRROM()
 {
+	if (pVideo == nullptr)
+		return;
+
+	Color* frame = pVideo->AcquireFrame();
+	const size_t width = pVideo->GetWidth();
 	for (unsigned int patternIndex = 0x0u; patternIndex < 0x200u; ++patternIndex)
 	{
 		unsigned int x = (patternIndex % 32) * 8;
@@ -254,7 +413,7 @@ void PPU_2C02::DisplayCHRROM()
 			for (unsigned int tileCol = 0; tileCol < 8u; ++tileCol)
 			{
 				ubyte colorIndex = ((ubyte)IsBitOn(7 - tileCol, patternHigh) << 1u) | (ubyte)IsBitOn(7 - tileCol, patternLow);
-				gfx.PutPixel(x + tileCol, y + tileRow, mSystemPalette[mGreyPalette[colorIndex]]);
+				frame[width * (y + tileRow) + x + tileCol] = mSystemPalette[mGreyPalette[colorIndex]];
 			}
 		}
 	}
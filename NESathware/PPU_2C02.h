@@ -1,51 +1,134 @@
 #pragma once
 #include "CommonTypes.h"
-#include "../SathwareEngine/Graphics.h"
+#include "../SathwareEngine/VideoSink.h"
+#include "PPURenderer.h"
+#include "NTSCFilter.h"
 
-/* TODO: Finish implementing sprite flags, implement 8x16 sprite mode, implement max 8 sprites per scanline bug, implement sprite overflow bug */
+/* TODO: implement sprite overflow bug (hardware false positives/negatives), sprite 0 hit and overflow are only accurate to the scanline */
 
 class PPU_2C02
 {
 public:
-	PPU_2C02(class BUS& bus, Graphics& gfx);
-	void Execute();
+	//video may be nullptr, frames are then only available through GetFrameIndices
+	PPU_2C02(class BUS& bus, VideoSink* video);
+	//Catch the PPU up to the current CPU cycle, called on register access and when NextEventDot is reached
+	void Sync();
+	//PPU cycle of the next VBLANK/NMI or pre-render point, the PPU does not need to run before then unless its registers are touched
+	ubyte8 NextEventDot() const
+	{
+		return mNextEventDot;
+	}
 	//Source: "https://www.nesdev.org/wiki/PPU_registers"
 	ubyte ReadRegister(ubyte2 address);
 	//Source: "https://www.nesdev.org/wiki/PPU_registers"
 	void WriteRegister(ubyte val, ubyte2 address);
 	//Bulk transfer OAM Data from CPU RAM to PPU
 	void WriteOAMDMA(ubyte* data);
+	//The cartridge pointed 1KB pattern table windows at other banks, bit n of windows is the window at n * $400
+	void PatternWindowsChanged(ubyte windows);
+	//Last completed frame as 256x240 system palette indexes (0 - 63), nullptr until the first frame is drawn
+	const ubyte* GetFrameIndices() const
+	{
+		const PPUFrameRecord* frame = mRenderer.GetLastFrame();
+		return frame != nullptr ? frame->FrameIndices : nullptr;
+	}
+	//Color emphasis bits (PPUMASK bits 5 - 7) for each scanline of the last completed frame, nullptr until the first frame is drawn
+	const ubyte* GetLineEmphasis() const
+	{
+		const PPUFrameRecord* frame = mRenderer.GetLastFrame();
+		return frame != nullptr ? frame->LineEmphasis : nullptr;
+	}
+	//Draw frames on a separate thread from per-scanline snapshots recorded during emulation, frames are presented from that thread
+	void SetRenderThread(bool threaded)
+	{
+		if (threaded)
+			mRenderer.StartThread();
+		else
+			mRenderer.StopThread();
+	}
+	//Check every frame drawn by the render thread against drawing it on the emulation thread, see GetRenderThreadMismatches
+	void SetVerifyRenderThread(bool verify)
+	{
+		mRenderer.SetVerifyThreadOutput(verify);
+	}
+	unsigned int GetRenderThreadMismatches() const
+	{
+		return mRenderer.GetVerifyMismatches();
+	}
+	//Pattern tiles read again from the cartridge for the last drawn frame, the rest came from the pattern cache
+	unsigned int GetPatternInvalidations() const
+	{
+		return mPatternInvalidations;
+	}
+	//Only draw and present one out of every (skip + 1) frames, timing visible state (VBLANK, NMI, sprite 0 hit, sprite overflow) is still emulated on skipped frames
+	void SetFrameSkip(unsigned int skip)
+	{
+		mFrameSkip = skip;
+	}
+	//Number of frames completed so far, including skipped frames
+	ubyte8 GetFrameCount() const
+	{
+		return mFrameCount;
+	}
+	//Convert the last completed frame to RGBA, out must hold 256x240 colors
+	void ConvertFrame(Color* out) const;
+	//Present frames through the NTSC composite filter instead of the flat palette from the next recorded frame on, the video sink has to be NTSCFilter::outputWidth wide
+	void SetNTSCFilter(bool enabled);
 	/*Debug*/
+	//Draw both pattern tables into the video sink's current frame, the caller publishes it
 	void DisplayCHRROM();
 	/*Emulation*/
 	ubyte2 nextNametableOffset;
 private:
 	BUS& Bus;
-	Graphics& gfx;
-
-	//A subpalette is 4 bytes long, and houses indexes into the system palette
-	struct SubPalette
-	{
-		//ColorIndexes[0] = background color index for mSystemPalette
-		//ColorIndexes[1 to 3] = color indexes for mSystemPalette
-		ubyte ColorIndexes[4];
-	};
-	//The OAM contains sprite data, 4 bytes per sprite, that describe the (x, y) position and pattern tile index and other flags
-	struct Sprite
-	{
-		ubyte PosYTop;
-		ubyte TileIndex;
-		ubyte Attributes;
-		ubyte PosXLeft;
-	};
+	VideoSink* pVideo;
 
 	/*Rendering*/
 	unsigned int mCurrentScanLine = 0;
 	unsigned int mCurrentCycle = 0;
-	//Render background, Background Info: "https://austinmorlan.com/posts/nes_rendering_overview/", "https://www.nesdev.org/wiki/Blargg_PPU", "https://www.nesdev.org/wiki/PPU_registers", "https://www.nesdev.org/wiki/PPU_nametables", "https://www.nesdev.org/wiki/PPU_pattern_tables"
-	void RenderBackground();
-	//Render Sprites, Source: "https://famicom.party/book/10-spritegraphics/"
-	void RenderSprites();
+	//Number of PPU cycles emulated so far, and the PPU cycle Sync next has to run at
+	ubyte8 mSyncedDot = 0;
+	ubyte8 mNextEventDot = 240u * 340u;
+	//Advance the PPU in bulk, one scanline at a time, until targetDot
+	void CatchUp(ubyte8 targetDot);
+	//Handle the VBLANK and pre-render events that happen on the first cycle of a scanline
+	void StartScanLine();
+	//Set mNextEventDot from the current position and registers
+	void ScheduleNextEvent();
+	//Cycle of scanLine on which pattern fetches raise PPU address line A12 for the cartridge's scanline counter, 0 if there is no rise or no counter
+	unsigned int A12RiseCycle(unsigned int scanLine) const;
+	unsigned int mFrameSkip = 0;
+	ubyte8 mFrameCount = 0;
+	//Snapshot PPU memory into a new frame record at the start of scanline 0
+	void BeginFrameRecord();
+	//Pattern tables as of the last drawn frame's start, only the tiles the cartridge marks dirty are read again
+	ubyte mPatternCache[0x2000u] = {};
+	unsigned int mPatternInvalidations = 0;
+	void RefreshPatternCache();
+	//Keep track of writes made while the current frame is recorded so the renderer sees them on the right scanline
+	void RecordWrite(bool isOAM, ubyte2 address, ubyte val);
+	//Set sprite overflow and sprite 0 hit for the scanline that is starting, done on every frame whether it is drawn or not
+	void UpdateSpriteFlags();
+	//Convert a drawn frame to RGBA and hand it to the video sink
+	void PresentFrame(const PPUFrameRecord& frame);
+	void ConvertFrame(const PPUFrameRecord& frame, Color* out) const;
+	//Emulation thread side of SetNTSCFilter, copied into every frame record
+	bool mNTSCFilterEnabled = false;
+	//Created and dropped by PresentFrame as the frames it gets ask for it, only used from whichever thread presents frames
+	std::unique_ptr<NTSCFilter> mpNTSCFilter;
+	//Frame currently being recorded, nullptr when the frame is skipped
+	PPUFrameRecord* mpRecord = nullptr;
+	//Per scanline sprite lists used for the sprite flags
+	ScanlineSprites mScanlineSprites[240u] = {};
+	//Reads PPU memory through the BUS, lets PPURenderer::BackgroundPixel run on live memory
+	struct LiveMemory
+	{
+		PPU_2C02& PPU;
+		ubyte Read(ubyte2 address) const
+		{
+			return PPU.Read(address);
+		}
+	};
 
 	/* Helper Functions */
 	bool isVBLANK()
@@ -56,6 +139,10 @@ private:
 	{
 		return IsBitOn<7>(mPPUCTRL);
 	}
+	unsigned int spriteHeight()
+	{
+		return IsBitOn<5>(mPPUCTRL) ? 16u : 8u;
+	}
 	ubyte Read(ubyte2 address);
 	void Write(ubyte val, ubyte2 address);
 
@@ -76,6 +163,9 @@ private:
 	//Used to simulate read buffer used internally in NES
 	ubyte mReadBuffer = 0;
 
+	//mSystemPalette with every combination of the 3 emphasis bits applied, indexed by [emphasis][palette index]
+	Color mEmphasisPalettes[8u][64u];
+
 	//Object Attribute Memory
 	ubyte mOAM[256u] = { 0 };
 	//Pallette
@@ -149,5 +239,7 @@ private:
 		{0x00,0x00,0x00,0xFF},
 		{0x00,0x00,0x00,0xFF}
 	};
-		
+
+	//Declared last so the render thread is stopped before anything it uses is destroyed
+	PPURenderer mRenderer;
 };
\ No newline at end of file
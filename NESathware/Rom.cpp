@@ -0,0 +1,109 @@
+#include "Rom.h"
+#include "RomDatabase.h"
+#include "../SathwareEngine/CRC32.h"
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+//NES 2.0 ROM size from the header's LSB and MSB nibble, in units of unit bytes
+//Sizes that aren't a multiple of the unit use exponent-multiplier notation, 2^E * (MM * 2 + 1) bytes
+static size_t ROMSize(ubyte lsb, ubyte msb, size_t unit)
+{
+	if (msb == 0x0fu)
+		return ((size_t)1u << (lsb >> 2u)) * ((lsb & 0x03u) * 2u + 1u);
+	return (((size_t)msb << 8u) | lsb) * unit;
+}
+
+//NES 2.0 RAM size from a shift count, 0 means none
+static size_t RAMSize(ubyte shift)
+{
+	return shift != 0 ? (size_t)64u << shift : 0;
+}
+
+std::shared_ptr<const Rom> Rom::Load(const std::filesystem::path& file)
+{
+	static std::mutex cacheMutex;
+	static std::unordered_map<std::filesystem::path::string_type, std::weak_ptr<const Rom>> cache;
+
+	//Different spellings of the same path have to find the same image
+	const std::filesystem::path key = std::filesystem::weakly_canonical(file);
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	std::shared_ptr<const Rom> rom = cache[key.native()].lock();
+	if (rom == nullptr)
+	{
+		//Forget images nobody uses anymore before adding one
+		std::erase_if(cache, [](const auto& entry) { return entry.second.expired(); });
+		rom = std::make_shared<const Rom>(key);
+		cache[key.native()] = rom;
+	}
+	return rom;
+}
+
+Rom::Rom(const std::filesystem::path& file)
+	: mFile(file)
+{
+	if (mFile.GetSize() < sizeof(Header) || memcmp(mFile.GetData(), "NES\x1a", 4u) != 0)
+		throw std::runtime_error("Not an iNES file");
+	const Header& header = GetHeader();
+
+	//NES 2.0 is marked by bits 2 - 3 of flags 7 being 10
+	mIsNES2 = (header.flags7 & 0x0cu) == 0x08u;
+	mMirroring = IsBitOn<0>(header.flags6) ? Mirroring::Vertical : Mirroring::Horizontal;
+	if (mIsNES2)
+	{
+		mMapper = ((header.flags8 & 0x0fu) << 8u) | (header.flags7 & 0xf0u) | (header.flags6 >> 4u);
+		mSubmapper = header.flags8 >> 4u;
+		mPRGSize = ROMSize(header.size_PRGRom, header.flags9 & 0x0fu, 0x4000u);
+		mCHRSize = ROMSize(header.size_CHRRom, header.flags9 >> 4u, 0x2000u);
+		mPRGRAMSize = RAMSize(header.flags10 & 0x0fu);
+		mPRGNVRAMSize = RAMSize(header.flags10 >> 4u);
+		mCHRRAMSize = RAMSize(header.flags11 & 0x0fu);
+		mCHRNVRAMSize = RAMSize(header.flags11 >> 4u);
+		mRegion = Region(header.flags12 & 0x03u);
+	}
+	else
+	{
+		//Old dumpers wrote their name from byte 7 on, when bytes 12 - 15 aren't 0 the high mapper nibble can't be trusted
+		const bool dirty = header.flags12 != 0 || header.flags13 != 0 || header.flags14 != 0 || header.flags15 != 0;
+		mMapper = (dirty ? 0 : header.flags7 & 0xf0u) | (header.flags6 >> 4u);
+		mPRGSize = (size_t)header.size_PRGRom * 0x4000u;
+		mCHRSize = (size_t)header.size_CHRRom * 0x2000u;
+		//Flags 8 is the PRG RAM size in 8KB units, 0 is 8KB for compatibility
+		const size_t prgRAMSize = (header.flags8 != 0 ? header.flags8 : 1u) * (size_t)0x2000u;
+		(IsBitOn<1>(header.flags6) ? mPRGNVRAMSize : mPRGRAMSize) = prgRAMSize;
+		mCHRRAMSize = mCHRSize == 0 ? 0x2000u : 0;
+		//Bit 0 of flags 9 marks PAL games, but few dumps set it
+		mRegion = !dirty && IsBitOn<0>(header.flags9) ? Region::PAL : Region::NTSC;
+	}
+
+	size_t offset = sizeof(Header);
+	if (IsBitOn<2>(header.flags6))
+	{
+		mpTrainer = mFile.GetData() + offset;
+		offset += 0x200u;
+	}
+	mpPRG = mFile.GetData() + offset;
+	offset += mPRGSize;
+	mpCHR = mFile.GetData() + offset;
+	offset += mCHRSize;
+	if (mPRGSize == 0)
+		throw std::runtime_error("ROM has no PRG ROM");
+	if (offset > mFile.GetSize())
+		throw std::runtime_error("ROM file is truncated");
+
+	//CHR ROM follows PRG ROM in the file, so one CRC covers both
+	mCRC = CRC32(mpPRG, mPRGSize + mCHRSize);
+	if (const RomInfo* info = RomInfo::Find(mCRC, mPRGSize + mCHRSize))
+	{
+		mMapper = info->Mapper;
+		mSubmapper = info->Submapper;
+		mMirroring = info->NametableMirroring;
+		mRegion = info->TVSystem;
+		mPRGRAMSize = RAMSize(info->PRGRAMShift);
+		mPRGNVRAMSize = RAMSize(info->PRGNVRAMShift);
+		mCHRRAMSize = RAMSize(info->CHRRAMShift);
+		mCHRNVRAMSize = RAMSize(info->CHRNVRAMShift);
+		mHeaderCorrected = true;
+	}
+}
@@ -0,0 +1,161 @@
+#pragma once
+#include "CommonTypes.h"
+#include "../SathwareEngine/MappedFile.h"
+#include <filesystem>
+#include <memory>
+
+//iNES file header, Source: "https://www.nesdev.org/wiki/INES" and "https://www.nesdev.org/wiki/NES_2.0"
+struct Header
+{
+	ubyte Type[4];
+	ubyte size_PRGRom;//size in 16KB units, low byte of it in NES 2.0
+	ubyte size_CHRRom;//size in 8KB units, low byte of it in NES 2.0
+	ubyte flags6;
+	ubyte flags7;
+	ubyte flags8;
+	ubyte flags9;
+	ubyte flags10;
+	//Only used by NES 2.0, some old iNES dumpers wrote their name here
+	ubyte flags11;
+	ubyte flags12;
+	ubyte flags13;
+	ubyte flags14;
+	ubyte flags15;
+};
+
+//How the 4 nametables map onto the 2KB of VRAM, Source: "https://www.nesdev.org/wiki/Mirroring#Nametable_Mirroring"
+enum class Mirroring : ubyte
+{
+	//$2000 = $2400, $2800 = $2c00 (vertical arrangement)
+	Horizontal,
+	//$2000 = $2800, $2400 = $2c00 (horizontal arrangement)
+	Vertical,
+	//All 4 nametables are the first or second 1KB of VRAM
+	SingleScreenLower,
+	SingleScreenUpper
+};
+
+//TV system the game was made for, in NES 2.0 order, Source: "https://www.nesdev.org/wiki/NES_2.0#Byte_12_(CPU/PPU_Timing)"
+enum class Region : ubyte
+{
+	NTSC,
+	PAL,
+	//Runs on NTSC and PAL consoles
+	Multiple,
+	Dendy
+};
+
+//A parsed iNES or NES 2.0 ROM file, PRG and CHR ROM point straight into the memory mapped file
+//Images are immutable and shared, every console running the same file in a process uses the same mapping
+//Dumps found in the ROM database get their mapper, mirroring, RAM sizes and region from it instead of the header, which is often wrong
+class Rom
+{
+public:
+	//Returns the image already loaded for the file if there is one, throws std::runtime_error if the file isn't a valid ROM
+	static std::shared_ptr<const Rom> Load(const std::filesystem::path& file);
+
+	Rom(const std::filesystem::path& file);
+
+	const Header& GetHeader() const
+	{
+		return *reinterpret_cast<const Header*>(mFile.GetData());
+	}
+	bool IsNES2() const
+	{
+		return mIsNES2;
+	}
+	ubyte2 GetMapper() const
+	{
+		return mMapper;
+	}
+	//0 if the header doesn't name one
+	ubyte GetSubmapper() const
+	{
+		return mSubmapper;
+	}
+	Mirroring GetMirroring() const
+	{
+		return mMirroring;
+	}
+	Region GetRegion() const
+	{
+		return mRegion;
+	}
+	//The cart has battery backed memory
+	bool HasBattery() const
+	{
+		return mPRGNVRAMSize != 0 || mCHRNVRAMSize != 0;
+	}
+	//CRC-32 of the PRG and CHR ROM, what the ROM database is keyed by
+	ubyte4 GetCRC() const
+	{
+		return mCRC;
+	}
+	//The header was replaced by the ROM database's entry for the dump
+	bool IsHeaderCorrected() const
+	{
+		return mHeaderCorrected;
+	}
+
+	//512 bytes that are loaded into $7000 - $71ff, nullptr if the file has no trainer
+	const ubyte* GetTrainer() const
+	{
+		return mpTrainer;
+	}
+	const ubyte* GetPRG() const
+	{
+		return mpPRG;
+	}
+	size_t GetPRGSize() const
+	{
+		return mPRGSize;
+	}
+	//nullptr if the cart uses CHR RAM
+	const ubyte* GetCHR() const
+	{
+		return mCHRSize != 0 ? mpCHR : nullptr;
+	}
+	size_t GetCHRSize() const
+	{
+		return mCHRSize;
+	}
+	//Volatile and battery backed RAM sizes in bytes, iNES files only give the PRG RAM size so it and 8KB of CHR RAM for carts without CHR ROM are assumed
+	size_t GetPRGRAMSize() const
+	{
+		return mPRGRAMSize;
+	}
+	size_t GetPRGNVRAMSize() const
+	{
+		return mPRGNVRAMSize;
+	}
+	size_t GetCHRRAMSize() const
+	{
+		return mCHRRAMSize;
+	}
+	size_t GetCHRNVRAMSize() const
+	{
+		return mCHRNVRAMSize;
+	}
+
+	Rom(const Rom& other) = delete;
+	Rom(const Rom&& other) = delete;
+	Rom& operator=(const Rom& other) = delete;
+private:
+	MappedFile mFile;
+	bool mIsNES2 = false;
+	ubyte2 mMapper = 0;
+	ubyte mSubmapper = 0;
+	Mirroring mMirroring = Mirroring::Horizontal;
+	Region mRegion = Region::NTSC;
+	ubyte4 mCRC = 0;
+	bool mHeaderCorrected = false;
+	const ubyte* mpTrainer = nullptr;
+	const ubyte* mpPRG = nullptr;
+	size_t mPRGSize = 0;
+	const ubyte* mpCHR = nullptr;
+	size_t mCHRSize = 0;
+	size_t mPRGRAMSize = 0;
+	size_t mPRGNVRAMSize = 0;
+	size_t mCHRRAMSize = 0;
+	size_t mCHRNVRAMSize = 0;
+};
@@ -0,0 +1,18 @@
+#include "RomDatabase.h"
+#include <algorithm>
+
+//The table is generated by GenerateRomDatabase.py, sorted by CRC so lookups are a binary search
+//The checked in one comes from RomDatabase.xml, regenerate it from the full nes20db.xml to correct every known dump
+#include "RomDatabase.inl"
+static_assert(std::ranges::is_sorted(database, {}, &RomInfo::CRC), "ROM database isn't sorted by CRC");
+
+const RomInfo* RomInfo::Find(ubyte4 crc, size_t size)
+{
+	auto entry = std::ranges::lower_bound(database, crc, {}, &RomInfo::CRC);
+	for (; entry != std::ranges::end(database) && entry->CRC == crc; ++entry)
+	{
+		if (entry->Size == size)
+			return &*entry;
+	}
+	return nullptr;
+}
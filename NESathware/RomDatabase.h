@@ -0,0 +1,23 @@
+#pragma once
+#include "Rom.h"
+
+//What a known dump really is, for ROMs whose iNES header is wrong, Source: "https://www.nesdev.org/wiki/NES_2.0_XML_Database"
+struct RomInfo
+{
+	//CRC-32 of the PRG and CHR ROM together, without the header and trainer
+	ubyte4 CRC;
+	//PRG and CHR ROM size in bytes, so a CRC collision with a different sized dump can't match
+	ubyte4 Size;
+	ubyte2 Mapper;
+	ubyte Submapper;
+	Mirroring NametableMirroring;
+	Region TVSystem;
+	//RAM sizes as NES 2.0 shift counts, 64 << n bytes, 0 is none
+	ubyte PRGRAMShift;
+	ubyte PRGNVRAMShift;
+	ubyte CHRRAMShift;
+	ubyte CHRNVRAMShift;
+
+	//nullptr if the dump isn't in the database
+	static const RomInfo* Find(ubyte4 crc, size_t size);
+};
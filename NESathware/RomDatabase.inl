@@ -0,0 +1,6 @@
+//Generated by GenerateRomDatabase.py from RomDatabase.xml, don't edit
+static constexpr RomInfo database[] =
+{
+	{ 0x158b0388u, 0x6000u, 0, 0, Mirroring::Horizontal, Region::NTSC, 0, 0, 0, 0 },//nestest.nes
+	{ 0xc3fdd379u, 0xa000u, 0, 0, Mirroring::Horizontal, Region::NTSC, 0, 0, 0, 0 },//scrolling.nes
+};
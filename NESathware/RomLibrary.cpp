@@ -0,0 +1,192 @@
+#include "RomLibrary.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+static constexpr char cacheMagic[4] = { 'N', 'E', 'S', 'L' };
+//Bumped whenever LibraryEntry changes, older cache files are ignored
+static constexpr ubyte4 cacheVersion = 1u;
+//Bytes each cache entry takes besides its path
+static constexpr size_t cacheEntrySize = sizeof(ubyte2) + sizeof(LibraryEntry::Modified) + sizeof(LibraryEntry::Size) + sizeof(LibraryEntry::Valid) +
+	sizeof(LibraryEntry::CRC) + sizeof(LibraryEntry::Mapper) + sizeof(LibraryEntry::Submapper) + sizeof(LibraryEntry::NametableMirroring) +
+	sizeof(LibraryEntry::TVSystem) + sizeof(LibraryEntry::Battery) + sizeof(LibraryEntry::PRGSize) + sizeof(LibraryEntry::CHRSize);
+
+template<class T>
+static void Write(std::ofstream& stream, const T& value)
+{
+	stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<class T>
+static bool Read(std::ifstream& stream, T& value)
+{
+	return (bool)stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+}
+
+RomLibrary::RomLibrary(const std::filesystem::path& cacheFile)
+	: mCacheFile(cacheFile)
+{
+	LoadCache();
+}
+
+LibraryScanStats RomLibrary::Scan(const std::filesystem::path& directory)
+{
+	const auto start = std::chrono::steady_clock::now();
+	LibraryScanStats stats;
+
+	std::unordered_map<std::filesystem::path::string_type, const LibraryEntry*> cached;
+	for (const LibraryEntry& entry : mEntries)
+		cached[entry.File.native()] = &entry;
+
+	//The directory listing already has the size and time of each file, so unchanged files are never opened
+	std::vector<LibraryEntry> entries;
+	std::vector<size_t> changed;
+	for (const std::filesystem::directory_entry& file : std::filesystem::recursive_directory_iterator(directory, std::filesystem::directory_options::skip_permission_denied))
+	{
+		std::wstring extension = file.path().extension().wstring();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](wchar_t c) { return (wchar_t)std::towlower(c); });
+		if (!file.is_regular_file() || extension != L".nes")
+			continue;
+
+		LibraryEntry entry;
+		entry.File = file.path();
+		entry.Modified = (ubyte8)file.last_write_time().time_since_epoch().count();
+		entry.Size = file.file_size();
+		auto found = cached.find(entry.File.native());
+		if (found != cached.end() && found->second->Modified == entry.Modified && found->second->Size == entry.Size)
+			entry = *found->second;
+		else
+		{
+			changed.push_back(entries.size());
+			stats.BytesScanned += entry.Size;
+		}
+		entries.push_back(std::move(entry));
+	}
+
+	//Each worker takes the next changed file until none are left, every file has its own slot so nothing is shared but the counter
+	std::atomic<size_t> next = 0;
+	auto worker = [&]()
+	{
+		for (size_t i = next++; i < changed.size(); i = next++)
+			ReadRom(entries[changed[i]]);
+	};
+	const size_t numThreads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 1u), changed.size());
+	std::vector<std::thread> threads;
+	for (size_t thread = 1u; thread < numThreads; ++thread)
+		threads.emplace_back(worker);
+	worker();
+	for (std::thread& thread : threads)
+		thread.join();
+
+	std::sort(entries.begin(), entries.end(), [](const LibraryEntry& a, const LibraryEntry& b) { return a.File < b.File; });
+	mEntries = std::move(entries);
+	if (!changed.empty() || cached.size() != mEntries.size())
+		SaveCache();
+
+	stats.Files = mEntries.size();
+	stats.Scanned = changed.size();
+	stats.Seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
+
+void RomLibrary::ReadRom(LibraryEntry& entry)
+{
+	//Not Rom::Load, the scan shouldn't keep thousands of files mapped
+	try
+	{
+		const Rom rom(entry.File);
+		entry.Valid = true;
+		entry.CRC = rom.GetCRC();
+		entry.Mapper = rom.GetMapper();
+		entry.Submapper = rom.GetSubmapper();
+		entry.NametableMirroring = rom.GetMirroring();
+		entry.TVSystem = rom.GetRegion();
+		entry.Battery = rom.HasBattery();
+		entry.PRGSize = (ubyte4)rom.GetPRGSize();
+		entry.CHRSize = (ubyte4)rom.GetCHRSize();
+	}
+	//Broken files stay in the library as invalid, so they aren't read again every scan
+	catch (const std::runtime_error&)
+	{}
+	catch (const Exception&)
+	{}
+}
+
+void RomLibrary::LoadCache()
+{
+	//Any cache that doesn't add up is left unloaded, the next scan then reads every file and writes a new one
+	std::error_code error;
+	const ubyte8 fileSize = std::filesystem::file_size(mCacheFile, error);
+	std::ifstream stream(mCacheFile, std::ifstream::binary);
+	char magic[4];
+	ubyte4 version, count;
+	if (error || !Read(stream, magic) || memcmp(magic, cacheMagic, sizeof(magic)) != 0 || !Read(stream, version) || version != cacheVersion || !Read(stream, count))
+		return;
+
+	//A truncated or corrupt file can claim any count or path length, so both are checked against what is left of the file before anything is allocated
+	ubyte8 remaining = fileSize - sizeof(magic) - sizeof(version) - sizeof(count);
+	if (count > remaining / cacheEntrySize)
+		return;
+	std::vector<LibraryEntry> entries(count);
+	for (LibraryEntry& entry : entries)
+	{
+		ubyte2 pathLength;
+		if (remaining < cacheEntrySize || !Read(stream, pathLength))
+			return;
+		remaining -= cacheEntrySize;
+		if (pathLength > remaining)
+			return;
+		remaining -= pathLength;
+		std::u8string path(pathLength, u8'\0');
+		if (!stream.read(reinterpret_cast<char*>(path.data()), pathLength))
+			return;
+		entry.File = path;
+		if (!Read(stream, entry.Modified) || !Read(stream, entry.Size) || !Read(stream, entry.Valid) || !Read(stream, entry.CRC) || !Read(stream, entry.Mapper)
+			|| !Read(stream, entry.Submapper) || !Read(stream, entry.NametableMirroring) || !Read(stream, entry.TVSystem) || !Read(stream, entry.Battery)
+			|| !Read(stream, entry.PRGSize) || !Read(stream, entry.CHRSize))
+			return;
+	}
+	if (remaining != 0)
+		return;
+	mEntries = std::move(entries);
+}
+
+void RomLibrary::SaveCache() const
+{
+	//Written to a temporary file first so a crash mid write can't leave a half cache behind
+	std::filesystem::path temporary = mCacheFile;
+	temporary += ".tmp";
+	{
+		std::ofstream stream(temporary, std::ofstream::binary | std::ofstream::trunc);
+		Write(stream, cacheMagic);
+		Write(stream, cacheVersion);
+		Write(stream, (ubyte4)mEntries.size());
+		for (const LibraryEntry& entry : mEntries)
+		{
+			const std::u8string path = entry.File.u8string();
+			Write(stream, (ubyte2)path.size());
+			stream.write(reinterpret_cast<const char*>(path.data()), path.size());
+			Write(stream, entry.Modified);
+			Write(stream, entry.Size);
+			Write(stream, entry.Valid);
+			Write(stream, entry.CRC);
+			Write(stream, entry.Mapper);
+			Write(stream, entry.Submapper);
+			Write(stream, entry.NametableMirroring);
+			Write(stream, entry.TVSystem);
+			Write(stream, entry.Battery);
+			Write(stream, entry.PRGSize);
+			Write(stream, entry.CHRSize);
+		}
+		if (!stream)
+			return;
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, mCacheFile, error);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "Rom.h"
+#include <filesystem>
+#include <vector>
+
+//A ROM file found by a library scan and what its header, or its ROM database entry, says about it
+struct LibraryEntry
+{
+	std::filesystem::path File;
+	//Last write time in file clock ticks and size in bytes, the file is only read again when one of them changes
+	ubyte8 Modified = 0;
+	ubyte8 Size = 0;
+	//false if the file isn't a valid ROM, the fields below are 0 then
+	bool Valid = false;
+	ubyte4 CRC = 0;
+	ubyte2 Mapper = 0;
+	ubyte Submapper = 0;
+	Mirroring NametableMirroring = Mirroring::Horizontal;
+	Region TVSystem = Region::NTSC;
+	bool Battery = false;
+	ubyte4 PRGSize = 0;
+	ubyte4 CHRSize = 0;
+};
+
+//What a RomLibrary::Scan did
+struct LibraryScanStats
+{
+	size_t Files = 0;
+	//Files that were new or changed, the rest came from the cache
+	size_t Scanned = 0;
+	ubyte8 BytesScanned = 0;
+	float Seconds = 0.0f;
+};
+
+//Index of every ROM under a directory
+//New and changed files are parsed and hashed on all cores, everything else comes from a cache file keyed by path, last write time and size
+class RomLibrary
+{
+public:
+	//Loads the cache file, a missing or unreadable one means the first scan reads every file
+	RomLibrary(const std::filesystem::path& cacheFile);
+
+	//Index the .nes files under directory and its subdirectories, drops entries for files that are gone and saves the cache
+	LibraryScanStats Scan(const std::filesystem::path& directory);
+	//Sorted by path
+	const std::vector<LibraryEntry>& GetEntries() const
+	{
+		return mEntries;
+	}
+
+	RomLibrary(const RomLibrary& other) = delete;
+	RomLibrary(const RomLibrary&& other) = delete;
+	RomLibrary& operator=(const RomLibrary& other) = delete;
+private:
+	//Fills in everything but File, Modified and Size
+	static void ReadRom(LibraryEntry& entry);
+	void LoadCache();
+	void SaveCache() const;
+
+	std::filesystem::path mCacheFile;
+	std::vector<LibraryEntry> mEntries;
+};
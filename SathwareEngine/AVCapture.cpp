@@ -0,0 +1,302 @@
+#include "AVCapture.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <string>
+
+AVCapture::AVCapture(const std::filesystem::path& videoFile, const std::filesystem::path& audioFile, size_t width, size_t height,
+	unsigned int frameRateNumerator, unsigned int frameRateDenominator, unsigned int sampleRate, VideoSink* display)
+	: mWidth(width), mHeight(height), mSampleRate(sampleRate), pDisplay(display),
+	mYUVFrame(width * height * 3u / 2u),
+	mVideoFrames(std::make_unique<VideoFrame[]>(numVideoFrames)), mAudioBlocks(std::make_unique<AudioBlock[]>(numAudioBlocks))
+{
+	if (mWidth % 2u != 0 || mHeight % 2u != 0)
+		throw Exception(L"Captured video needs an even width and height!");
+	if (pDisplay != nullptr && (pDisplay->GetWidth() != mWidth || pDisplay->GetHeight() != mHeight))
+		throw Exception(L"Captured video must be the same size as the display!");
+	if (pDisplay == nullptr)
+		mFrame = std::make_unique<Color[]>(mWidth * mHeight);
+
+	mVideoFile.open(videoFile, std::ios_base::binary | std::ios_base::trunc);
+	if (!mVideoFile.is_open())
+		throw Exception(L"Failed to open video capture file!");
+	mAudioFile.open(audioFile, std::ios_base::binary | std::ios_base::trunc);
+	if (!mAudioFile.is_open())
+		throw Exception(L"Failed to open audio capture file!");
+
+	//Source: "https://wiki.multimedia.cx/index.php/YUV4MPEG2"
+	const std::string header = "YUV4MPEG2 W" + std::to_string(mWidth) + " H" + std::to_string(mHeight) +
+		" F" + std::to_string(frameRateNumerator) + ":" + std::to_string(frameRateDenominator) + " Ip A1:1 C420jpeg\n";
+	mVideoFile.write(header.data(), header.size());
+	//Chunk sizes are filled in again once the writer is done
+	WriteWAVHeader(mAudioFile, mSampleRate, 0);
+
+	for (unsigned int i = 0; i < numVideoFrames; ++i)
+	{
+		mVideoFrames[i].Pixels = std::make_unique<Color[]>(mWidth * mHeight);
+		mFreeVideoFrames.Push(&mVideoFrames[i]);
+	}
+	for (unsigned int i = 0; i < numAudioBlocks; ++i)
+		mFreeAudioBlocks.Push(&mAudioBlocks[i]);
+
+	mWriter = std::thread(&AVCapture::WriterThread, this);
+}
+
+AVCapture::~AVCapture()
+{
+	//The writer drains every queued frame and block before it exits
+	mWriting = false;
+	NotifyWriter();
+	mWriter.join();
+	WriteWAVHeader(mAudioFile, mSampleRate, mWrittenSamples);
+}
+
+void AVCapture::PublishFrame()
+{
+	VideoFrame* captured = nullptr;
+	if (mFreeVideoFrames.Pop(captured))
+	{
+		memcpy(captured->Pixels.get(), AcquireFrame(), mWidth * mHeight * sizeof(Color));
+		//Frames dropped since the last captured one are filled with this one so the video keeps its length
+		captured->Repeat = 1u + mPendingDrops;
+		mPendingDrops = 0;
+		mPendingVideoFrames.Push(captured);
+		++mCapturedFrames;
+		NotifyWriter();
+	}
+	else
+	{
+		++mDroppedFrames;
+		++mPendingDrops;
+	}
+
+	if (pDisplay != nullptr)
+		pDisplay->PublishFrame();
+}
+
+void AVCapture::SubmitAudio(const float* samples, size_t count)
+{
+	while (count > 0)
+	{
+		AudioBlock* block = nullptr;
+		if (!mFreeAudioBlocks.Pop(block))
+		{
+			//Dropped samples become silence in front of the next block so audio stays in sync with video
+			mDroppedSamples += count;
+			mPendingSilence += count;
+			break;
+		}
+
+		block->Count = std::min(count, AudioBlock::capacity);
+		memcpy(block->Samples, samples, block->Count * sizeof(float));
+		block->SilenceBefore = mPendingSilence;
+		mPendingSilence = 0;
+		mPendingAudioBlocks.Push(block);
+
+		samples += block->Count;
+		count -= block->Count;
+	}
+	NotifyWriter();
+}
+
+void AVCapture::NotifyWriter()
+{
+	++mSubmitCount;
+	mSubmitCount.notify_one();
+}
+
+void AVCapture::WriterThread()
+{
+	while (true)
+	{
+		const unsigned int submitCount = mSubmitCount.load();
+		bool wroteSomething = false;
+
+		VideoFrame* frame = nullptr;
+		while (mPendingVideoFrames.Pop(frame))
+		{
+			WriteVideoFrame(*frame);
+			mFreeVideoFrames.Push(frame);
+			wroteSomething = true;
+		}
+		AudioBlock* block = nullptr;
+		while (mPendingAudioBlocks.Pop(block))
+		{
+			WriteAudioBlock(*block);
+			mFreeAudioBlocks.Push(block);
+			wroteSomething = true;
+		}
+
+		if (wroteSomething)
+			continue;
+		if (!mWriting)
+			return;
+		//Sleep until the producer submits something new
+		mSubmitCount.wait(submitCount);
+	}
+}
+
+void AVCapture::WriteVideoFrame(const VideoFrame& frame)
+{
+	//Identical frames (e.g. pause screens) reuse the last conversion
+	const unsigned __int64 frameHash = HashRow(frame.Pixels.get(), mWidth * mHeight);
+	if (!mHasLastFrame || frameHash != mLastFrameHash)
+	{
+		unsigned __int8* yPlane = mYUVFrame.data();
+		unsigned __int8* uPlane = yPlane + mWidth * mHeight;
+		unsigned __int8* vPlane = uPlane + mWidth * mHeight / 4u;
+		ConvertToI420(frame.Pixels.get(), mWidth, mHeight, yPlane, uPlane, vPlane);
+		mLastFrameHash = frameHash;
+		mHasLastFrame = true;
+	}
+	else
+		++mUnchangedFrames;
+
+	for (unsigned int i = 0; i < frame.Repeat; ++i)
+	{
+		mVideoFile.write("FRAME\n", 6);
+		mVideoFile.write(reinterpret_cast<const char*>(mYUVFrame.data()), mYUVFrame.size());
+	}
+}
+
+void AVCapture::WriteAudioBlock(const AudioBlock& block)
+{
+	const float silence[256u] = {};
+	for (size_t remaining = block.SilenceBefore; remaining > 0;)
+	{
+		const size_t count = std::min(remaining, std::size(silence));
+		mAudioFile.write(reinterpret_cast<const char*>(silence), count * sizeof(float));
+		remaining -= count;
+	}
+	mAudioFile.write(reinterpret_cast<const char*>(block.Samples), block.Count * sizeof(float));
+	mWrittenSamples += block.SilenceBefore + block.Count;
+}
+
+//Source: "http://soundfile.sapp.org/doc/WaveFormat/"
+void AVCapture::WriteWAVHeader(std::ostream& file, unsigned int sampleRate, size_t samples)
+{
+	auto writeU32 = [&file](unsigned __int32 val) { file.write(reinterpret_cast<const char*>(&val), 4); };
+	auto writeU16 = [&file](unsigned __int16 val) { file.write(reinterpret_cast<const char*>(&val), 2); };
+
+	const unsigned __int32 dataBytes = (unsigned __int32)(samples * sizeof(float));
+	file.seekp(0);
+	file.write("RIFF", 4);
+	writeU32(36u + dataBytes);
+	file.write("WAVEfmt ", 8);
+	writeU32(16u);
+	//WAVE_FORMAT_IEEE_FLOAT, mono
+	writeU16(3u);
+	writeU16(1u);
+	writeU32(sampleRate);
+	writeU32(sampleRate * (unsigned __int32)sizeof(float));
+	writeU16((unsigned __int16)sizeof(float));
+	writeU16(32u);
+	file.write("data", 4);
+	writeU32(dataBytes);
+	file.seekp(0, std::ios_base::end);
+}
+
+//Split 8 RGBA pixels held in two registers into 16 bit r, g and b lanes
+static void SplitChannels(__m128i pixels0, __m128i pixels1, __m128i& r, __m128i& g, __m128i& b)
+{
+	const __m128i byteMask = _mm_set1_epi32(0xff);
+	r = _mm_packs_epi32(_mm_and_si128(pixels0, byteMask), _mm_and_si128(pixels1, byteMask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(pixels0, 8), byteMask), _mm_and_si128(_mm_srli_epi32(pixels1, 8), byteMask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(pixels0, 16), byteMask), _mm_and_si128(_mm_srli_epi32(pixels1, 16), byteMask));
+}
+
+//(cr * r + cg * g + cb * b + bias) >> 8 on 8 lanes
+//The biases below keep every result in 0 - 65535, so wrapping 16 bit math gives the exact answer even with negative coefficients
+static __m128i WeightedSum(__m128i r, __m128i g, __m128i b, short cr, short cg, short cb, unsigned short bias)
+{
+	__m128i sum = _mm_mullo_epi16(r, _mm_set1_epi16(cr));
+	sum = _mm_add_epi16(sum, _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+	sum = _mm_add_epi16(sum, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+	sum = _mm_add_epi16(sum, _mm_set1_epi16((short)bias));
+	return _mm_srli_epi16(sum, 8);
+}
+
+static unsigned __int8 WeightedSum(unsigned int r, unsigned int g, unsigned int b, int cr, int cg, int cb, int bias)
+{
+	return (unsigned __int8)((cr * (int)r + cg * (int)g + cb * (int)b + bias) >> 8);
+}
+
+//Rounded up average, same as _mm_avg_epu8
+static unsigned int Average(unsigned int a, unsigned int b)
+{
+	return (a + b + 1u) >> 1u;
+}
+
+void AVCapture::ConvertToI420(const Color* rgba, size_t width, size_t height, unsigned __int8* yPlane, unsigned __int8* uPlane, unsigned __int8* vPlane)
+{
+	//Y = 0.299R + 0.587G + 0.114B, U = -0.169R - 0.331G + 0.5B + 128, V = 0.5R - 0.419G - 0.081B + 128, in 8 bit fixed point
+	constexpr short yr = 77, yg = 150, yb = 29;
+	constexpr short ur = -43, ug = -85, ub = 128;
+	constexpr short vr = 128, vg = -107, vb = -21;
+	constexpr unsigned short yBias = 128u;
+	constexpr unsigned short uvBias = 128u * 256u + 127u;
+
+	const size_t chromaWidth = width / 2u;
+	for (size_t y = 0; y < height; y += 2u)
+	{
+		const Color* rows[2] = { &rgba[y * width], &rgba[(y + 1u) * width] };
+		unsigned __int8* yRows[2] = { &yPlane[y * width], &yPlane[(y + 1u) * width] };
+		unsigned __int8* uRow = &uPlane[(y / 2u) * chromaWidth];
+		unsigned __int8* vRow = &vPlane[(y / 2u) * chromaWidth];
+
+		//16 pixels wide and 2 rows high at a time, giving 32 luma and 8 chroma samples
+		size_t x = 0;
+		for (; x + 16u <= width; x += 16u)
+		{
+			__m128i pixels[2][4];
+			for (unsigned int row = 0; row < 2u; ++row)
+			{
+				for (unsigned int i = 0; i < 4u; ++i)
+					pixels[row][i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&rows[row][x + i * 4u]));
+
+				__m128i r, g, b;
+				SplitChannels(pixels[row][0], pixels[row][1], r, g, b);
+				const __m128i luma0 = WeightedSum(r, g, b, yr, yg, yb, yBias);
+				SplitChannels(pixels[row][2], pixels[row][3], r, g, b);
+				const __m128i luma1 = WeightedSum(r, g, b, yr, yg, yb, yBias);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(&yRows[row][x]), _mm_packus_epi16(luma0, luma1));
+			}
+
+			//Average vertically, then average horizontal pixel pairs into the low pixel of every 8 byte lane
+			__m128i blocks[4];
+			for (unsigned int i = 0; i < 4u; ++i)
+			{
+				const __m128i vertical = _mm_avg_epu8(pixels[0][i], pixels[1][i]);
+				const __m128i pairs = _mm_avg_epu8(vertical, _mm_srli_epi64(vertical, 32));
+				//Move the 2 averaged pixels to the low 8 bytes
+				blocks[i] = _mm_shuffle_epi32(pairs, _MM_SHUFFLE(3, 1, 2, 0));
+			}
+			__m128i r, g, b;
+			SplitChannels(_mm_unpacklo_epi64(blocks[0], blocks[1]), _mm_unpacklo_epi64(blocks[2], blocks[3]), r, g, b);
+			const __m128i u = WeightedSum(r, g, b, ur, ug, ub, uvBias);
+			const __m128i v = WeightedSum(r, g, b, vr, vg, vb, uvBias);
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(&uRow[x / 2u]), _mm_packus_epi16(u, u));
+			_mm_storel_epi64(reinterpret_cast<__m128i*>(&vRow[x / 2u]), _mm_packus_epi16(v, v));
+		}
+
+		//Leftover columns, gives the same results as the SIMD path
+		for (; x < width; x += 2u)
+		{
+			unsigned int average[3] = {};
+			for (unsigned int channel = 0; channel < 3u; ++channel)
+			{
+				auto channelAt = [&](unsigned int row, size_t col) { return (rows[row][col].rgba >> (channel * 8u)) & 0xffu; };
+				average[channel] = Average(Average(channelAt(0, x), channelAt(1, x)), Average(channelAt(0, x + 1u), channelAt(1, x + 1u)));
+			}
+			for (unsigned int row = 0; row < 2u; ++row)
+			{
+				for (size_t col = x; col < x + 2u; ++col)
+				{
+					const unsigned int pixel = rows[row][col].rgba;
+					yRows[row][col] = WeightedSum(pixel & 0xffu, (pixel >> 8u) & 0xffu, (pixel >> 16u) & 0xffu, yr, yg, yb, yBias);
+				}
+			}
+			uRow[x / 2u] = WeightedSum(average[0], average[1], average[2], ur, ug, ub, uvBias);
+			vRow[x / 2u] = WeightedSum(average[0], average[1], average[2], vr, vg, vb, uvBias);
+		}
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include "VideoSink.h"
+#include "SPSCQueue.h"
+#include "SathwareException.h"
+#include "SathwareEngine.h"
+
+//Records video to a YUV4MPEG2 (.y4m) file and audio to a 32 bit float WAV file
+//Sits in front of an optional display sink, frames pass through to it unchanged after being copied for the capture
+//Encoding and file writes happen on a writer thread fed through bounded queues, when the writer falls behind frames and samples are dropped instead of stalling the producer
+class SathwareAPI AVCapture : public VideoSink
+{
+public:
+	//display may be nullptr to capture without showing anything, width and height have to be even
+	AVCapture(const std::filesystem::path& videoFile, const std::filesystem::path& audioFile, size_t width, size_t height,
+		unsigned int frameRateNumerator, unsigned int frameRateDenominator, unsigned int sampleRate, VideoSink* display = nullptr);
+	//Writes out everything still queued and finishes both files
+	~AVCapture() override;
+
+	/* Video */
+	size_t GetWidth() const override
+	{
+		return mWidth;
+	}
+	size_t GetHeight() const override
+	{
+		return mHeight;
+	}
+	Color* AcquireFrame() override
+	{
+		return pDisplay != nullptr ? pDisplay->AcquireFrame() : mFrame.get();
+	}
+	unsigned __int8* AcquireIndexedFrame() override
+	{
+		return pDisplay != nullptr ? pDisplay->AcquireIndexedFrame() : nullptr;
+	}
+	void PublishFrame() override;
+
+	/* Audio */
+	//Producer thread only, queue mono samples for the WAV file
+	void SubmitAudio(const float* samples, size_t count);
+
+	/* Stats */
+	unsigned __int64 GetCapturedFrames() const
+	{
+		return mCapturedFrames;
+	}
+	unsigned __int64 GetDroppedFrames() const
+	{
+		return mDroppedFrames;
+	}
+	unsigned __int64 GetDroppedSamples() const
+	{
+		return mDroppedSamples;
+	}
+	//Captured frames that were the same as the frame before and didn't need converting again
+	unsigned __int64 GetUnchangedFrames() const
+	{
+		return mUnchangedFrames;
+	}
+
+	/* Conversion */
+	//Full range BT.601 RGB to planar YUV 4:2:0, chroma is the average of every 2x2 block, Source: "https://en.wikipedia.org/wiki/YCbCr#JPEG_conversion"
+	static void ConvertToI420(const Color* rgba, size_t width, size_t height, unsigned __int8* yPlane, unsigned __int8* uPlane, unsigned __int8* vPlane);
+	//(Re)write the header of a mono 32 bit float WAV file holding samples samples, leaves the file positioned at its end
+	static void WriteWAVHeader(std::ostream& file, unsigned int sampleRate, size_t samples);
+
+	AVCapture(const AVCapture& other) = delete;
+	AVCapture(const AVCapture&& other) = delete;
+	AVCapture& operator=(const AVCapture& other) = delete;
+private:
+	struct VideoFrame
+	{
+		std::unique_ptr<Color[]> Pixels;
+		//Number of times to write the frame, more than 1 when frames before it were dropped
+		unsigned int Repeat;
+	};
+	struct AudioBlock
+	{
+		static constexpr size_t capacity = 2048u;
+		float Samples[capacity];
+		size_t Count;
+		//Number of dropped samples to write as silence before this block
+		size_t SilenceBefore;
+	};
+
+	void WriterThread();
+	void WriteVideoFrame(const VideoFrame& frame);
+	void WriteAudioBlock(const AudioBlock& block);
+	void NotifyWriter();
+
+	size_t mWidth;
+	size_t mHeight;
+	unsigned int mSampleRate;
+	VideoSink* pDisplay;
+	//Frame to draw into when there is no display
+	std::unique_ptr<Color[]> mFrame;
+
+	//Writer thread only
+	std::ofstream mVideoFile;
+	std::ofstream mAudioFile;
+	std::vector<unsigned __int8> mYUVFrame;
+	//Hash of the frame in mYUVFrame
+	unsigned __int64 mLastFrameHash = 0;
+	bool mHasLastFrame = false;
+	unsigned __int64 mWrittenSamples = 0;
+
+	//Frames and blocks are owned here and cycle between the free queues and the writer thread
+	static constexpr unsigned int numVideoFrames = 8u;
+	static constexpr unsigned int numAudioBlocks = 32u;
+	std::unique_ptr<VideoFrame[]> mVideoFrames;
+	std::unique_ptr<AudioBlock[]> mAudioBlocks;
+	//Writer thread -> producer
+	SPSCQueue<VideoFrame*, numVideoFrames> mFreeVideoFrames;
+	SPSCQueue<AudioBlock*, numAudioBlocks> mFreeAudioBlocks;
+	//Producer -> writer thread
+	SPSCQueue<VideoFrame*, numVideoFrames> mPendingVideoFrames;
+	SPSCQueue<AudioBlock*, numAudioBlocks> mPendingAudioBlocks;
+
+	std::thread mWriter;
+	std::atomic<bool> mWriting = true;
+	//Bumped on every submit so the writer thread can sleep on it
+	std::atomic<unsigned int> mSubmitCount = 0;
+
+	unsigned __int64 mCapturedFrames = 0;
+	unsigned __int64 mDroppedFrames = 0;
+	unsigned __int64 mDroppedSamples = 0;
+	std::atomic<unsigned __int64> mUnchangedFrames = 0;
+	//Producer thread only, drops not yet attached to a captured frame or block
+	unsigned int mPendingDrops = 0;
+	size_t mPendingSilence = 0;
+};
@@ -1,12 +1,9 @@
 #include "Audio.h"
-#include <numbers>
-#include <random>
+#include <algorithm>
 
-template <typename T> int sgn(T val) {
-	return (T(0) < val) - (val < T(0));
-}
-
-Audio::Audio()
+Audio::Audio(AudioStream& stream)
+	: Stream(stream), mBufferSamples(std::max<size_t>(stream.GetLatencySamples() / numBuffers, 1u)),
+	mBuffers(std::make_unique<float[]>(mBufferSamples * numBuffers))
 {
 	HRESULT result;
 	result = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
@@ -16,45 +13,53 @@ Audio::Audio()
 	ThrowIfFailed(result, L"Failed call to XAudio2Create to instantiate the xaudio2 engine!");
 
 	result = mXAudio2->CreateMasteringVoice(&mMasteringVoice);
+	ThrowIfFailed(result, L"Failed call to CreateMasteringVoice to instantiate a mastering voice!");
 
 	// Create a source voice
 	WAVEFORMATEX waveformat;
 	waveformat.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
 	waveformat.nChannels = 1;
-	waveformat.nSamplesPerSec = sampleFrequency;
-	waveformat.nAvgBytesPerSec = sampleFrequency * bitsPerSample / 8;
+	waveformat.nSamplesPerSec = Stream.GetSampleRate();
+	waveformat.nAvgBytesPerSec = Stream.GetSampleRate() * bitsPerSample / 8;
 	waveformat.nBlockAlign = bitsPerSample / 8;
 	waveformat.wBitsPerSample = bitsPerSample;
 	waveformat.cbSize = 0;
 
-	result = mXAudio2->CreateSourceVoice(&mSourceVoice, &waveformat);
+	result = mXAudio2->CreateSourceVoice(&mSourceVoice, &waveformat, 0, XAUDIO2_DEFAULT_FREQ_RATIO, this);
 	ThrowIfFailed(result, L"Failed call to CreateSourceVoice to instantiate a source voice!");
 
+	//Start on silence, the stream takes over as the first buffers finish
+	for (size_t i = 0; i < numBuffers; ++i)
+		SubmitBuffer(i);
+
 	// Start the source voice
 	result = mSourceVoice->Start();
+	ThrowIfFailed(result, L"Failed call to Start to play the source voice!");
+}
 
-	// Fill audio data
-	for (unsigned int i = 0; i < sampleFrequency * 5; ++i)
-	{
-		float t = float(i) / 44100.0f;
-		float freq = 220.0f;
-		constexpr float pi2 = 2.0f * float(std::numbers::pi);
-		// Reference: "https://thewolfsound.com/sine-saw-square-triangle-pulse-basic-waveforms-in-synthesis/#sine"
-		soundData[i] = sinf(2.0f * float(std::numbers::pi) * freq * t);
-		//soundData[i] = 0.1f * sgn(sinf(2.0f * float(std::numbers::pi) * freq * t));
-		//soundData[i] = 4.0f * fabs(freq*t - floorf(freq*t + 0.5f)) - 1.0f;
-	}
+Audio::~Audio()
+{
+	//Destroying the voice waits for a running callback and stops new ones, the buffers can go after that
+	if (mSourceVoice != nullptr)
+		mSourceVoice->DestroyVoice();
+	if (mMasteringVoice != nullptr)
+		mMasteringVoice->DestroyVoice();
 }
 
-void Audio::PlaySine()
+void Audio::OnBufferEnd(void* pBufferContext)
+{
+	const size_t index = reinterpret_cast<size_t>(pBufferContext);
+	Stream.Read(&mBuffers[index * mBufferSamples], mBufferSamples);
+	SubmitBuffer(index);
+}
+
+void Audio::SubmitBuffer(size_t index)
 {
 	XAUDIO2_BUFFER buffer = { 0 };
-	buffer.AudioBytes = 5 * sampleFrequency * bitsPerSample / 8;
-	buffer.pAudioData = reinterpret_cast<byte*>(&soundData);
-	buffer.Flags = XAUDIO2_END_OF_STREAM;
-	buffer.PlayBegin = 0;
-	buffer.PlayLength = 5 * 44100;
-
-	HRESULT result = mSourceVoice->SubmitSourceBuffer(&buffer);
-	ThrowIfFailed(result, L"Failed call to SubmitSourceBuffer to play sound!");
+	buffer.AudioBytes = (UINT32)(mBufferSamples * bitsPerSample / 8);
+	buffer.pAudioData = reinterpret_cast<const BYTE*>(&mBuffers[index * mBufferSamples]);
+	buffer.pContext = reinterpret_cast<void*>(index);
+
+	//Can't throw here, this also runs on XAudio2's callback thread
+	mSourceVoice->SubmitSourceBuffer(&buffer);
 }
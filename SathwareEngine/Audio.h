@@ -1,15 +1,18 @@
 #pragma once
 #include <xaudio2.h>
 #include <wrl.h>
+#include <memory>
+#include "AudioStream.h"
 #include "SathwareException.h"
 #include "SathwareEngine.h"
 
-class SathwareAPI Audio
+//XAudio2 backend, streams an AudioStream through a few small source buffers
+//Every time XAudio2 finishes a buffer it is refilled from the stream and queued again on XAudio2's callback thread
+class SathwareAPI Audio : private IXAudio2VoiceCallback
 {
 public:
-	Audio();
-
-	void PlaySine();
+	Audio(AudioStream& stream);
+	~Audio();
 
 	Audio(const Audio& other) = delete;
 	Audio(const Audio&& other) = delete;
@@ -18,11 +21,23 @@ private:
 	template <typename T>
 	using ComPtr = Microsoft::WRL::ComPtr<T>;
 
+	//Refill and resubmit the buffer XAudio2 is done with, pBufferContext is its index
+	void STDMETHODCALLTYPE OnBufferEnd(void* pBufferContext) override;
+	void STDMETHODCALLTYPE OnVoiceProcessingPassStart(UINT32) override {}
+	void STDMETHODCALLTYPE OnVoiceProcessingPassEnd() override {}
+	void STDMETHODCALLTYPE OnStreamEnd() override {}
+	void STDMETHODCALLTYPE OnBufferStart(void*) override {}
+	void STDMETHODCALLTYPE OnLoopEnd(void*) override {}
+	void STDMETHODCALLTYPE OnVoiceError(void*, HRESULT) override {}
+	void SubmitBuffer(size_t index);
+
+	AudioStream& Stream;
 	ComPtr<IXAudio2> mXAudio2;
-	IXAudio2MasteringVoice* mMasteringVoice;
-	IXAudio2SourceVoice* mSourceVoice;
+	IXAudio2MasteringVoice* mMasteringVoice = nullptr;
+	IXAudio2SourceVoice* mSourceVoice = nullptr;
 	static constexpr unsigned int bitsPerSample = 32;
-	static constexpr unsigned int sampleFrequency = 44100;
-	static constexpr unsigned int numBytes = bitsPerSample * 5 * sampleFrequency;
-	float soundData[5 * sampleFrequency];
-};
\ No newline at end of file
+	//The stream's latency is split over this many buffers, one plays while the others wait
+	static constexpr size_t numBuffers = 3u;
+	size_t mBufferSamples;
+	std::unique_ptr<float[]> mBuffers;
+};
@@ -0,0 +1,41 @@
+#include "AudioRateControl.h"
+#include <algorithm>
+
+//Weight of the newest fill in the smoothed fill, about an 8 frame time constant
+static constexpr double fillSmoothing = 0.125;
+//Part of the error added to the integral term every update, it takes about 2 seconds of full error at 60 updates per second to reach the full deviation
+static constexpr double integralGain = 1.0 / 120.0;
+
+AudioRateControl::AudioRateControl(const AudioStream& stream, double maxDeviation)
+	: Stream(stream), mMaxDeviation(maxDeviation), mTargetFill(stream.GetLatencySamples()), mSmoothedFill(double(stream.GetLatencySamples()))
+{}
+
+double AudioRateControl::Update()
+{
+	const size_t fill = Stream.GetFill();
+	mSmoothedFill += (double(fill) - mSmoothedFill) * fillSmoothing;
+
+	//The proportional term is linear in the distance from the target, full deviation once the ring is empty or twice the target
+	//It alone would settle away from the target when the clocks drift, the integral term slowly takes over that constant offset
+	const double error = std::clamp((double(mTargetFill) - mSmoothedFill) / double(mTargetFill), -1.0, 1.0);
+	mIntegral = std::clamp(mIntegral + error * integralGain, -1.0, 1.0);
+	mRatio = 1.0 + std::clamp(error + mIntegral, -1.0, 1.0) * mMaxDeviation;
+
+	if (mTelemetry.is_open())
+		mTelemetry << mUpdates << ',' << fill << ',' << mSmoothedFill << ',' << mRatio << ',' << Stream.GetUnderruns() << ',' << Stream.GetOverruns() << '\n';
+	++mUpdates;
+	return mRatio;
+}
+
+void AudioRateControl::OpenTelemetry(const std::filesystem::path& file)
+{
+	mTelemetry.open(file, std::ios_base::trunc);
+	if (!mTelemetry.is_open())
+		throw Exception(L"Failed to open audio telemetry file!");
+	mTelemetry << "update,fill,smoothed_fill,ratio,underruns,overruns\n";
+}
+
+void AudioRateControl::CloseTelemetry()
+{
+	mTelemetry.close();
+}
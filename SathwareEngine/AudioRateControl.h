@@ -0,0 +1,47 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include "AudioStream.h"
+#include "SathwareException.h"
+#include "SathwareEngine.h"
+
+//Dynamic rate control, keeps an AudioStream near a target fill when the emulator isn't clocked by the sound card (timer or vsync pacing)
+//Once per frame the producer asks for a resampling ratio: a little over 1 makes more samples when the ring runs low, a little under 1 fewer when it fills up
+//The deviation is small enough that the pitch change can't be heard, Source: "https://github.com/libretro/docs/blob/master/archive/ratecontrol.pdf"
+class SathwareAPI AudioRateControl
+{
+public:
+	//maxDeviation is the largest change to the ratio, 0.005 is +-0.5%
+	AudioRateControl(const AudioStream& stream, double maxDeviation = 0.005);
+
+	//Emulation thread, after every frame's samples were written, returns the ratio to resample the next frame with
+	double Update();
+	double GetRatio() const
+	{
+		return mRatio;
+	}
+	//Fill the ratio steers towards, the stream's latency
+	size_t GetTargetFill() const
+	{
+		return mTargetFill;
+	}
+
+	//Write one CSV line per Update for tuning: update, fill, smoothed fill, ratio, underruns, overruns
+	void OpenTelemetry(const std::filesystem::path& file);
+	void CloseTelemetry();
+
+	AudioRateControl(const AudioRateControl& other) = delete;
+	AudioRateControl(const AudioRateControl&& other) = delete;
+	AudioRateControl& operator=(const AudioRateControl& other) = delete;
+private:
+	const AudioStream& Stream;
+	double mMaxDeviation;
+	size_t mTargetFill;
+	//The fill jumps by a whole backend buffer whenever one is taken, averaging over a few frames keeps that out of the ratio
+	double mSmoothedFill;
+	//Sum of past errors, in units of the max deviation
+	double mIntegral = 0.0;
+	double mRatio = 1.0;
+	unsigned __int64 mUpdates = 0;
+	std::ofstream mTelemetry;
+};
@@ -0,0 +1,65 @@
+#include "AudioStream.h"
+#include "SathwareException.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+AudioStream::AudioStream(unsigned int sampleRate, unsigned int latencyMs)
+	: mSampleRate(sampleRate), mLatencySamples((size_t)sampleRate * latencyMs / 1000u),
+	mCapacity(std::bit_ceil(mLatencySamples * 4u)), mSamples(std::make_unique<float[]>(mCapacity))
+{
+	if (mLatencySamples == 0)
+		throw Exception(L"Audio latency has to be at least one sample!");
+}
+
+size_t AudioStream::Write(const float* samples, size_t count)
+{
+	const size_t tail = mTail.load(std::memory_order_relaxed);
+	const size_t free = mCapacity - (tail - mHead.load(std::memory_order_acquire));
+	const size_t written = std::min(count, free);
+	if (written < count)
+	{
+		++mOverruns;
+		mOverrunSamples += count - written;
+	}
+
+	//At most two copies, up to the end of the ring and from its start
+	const size_t start = tail & (mCapacity - 1u);
+	const size_t first = std::min(written, mCapacity - start);
+	memcpy(&mSamples[start], samples, first * sizeof(float));
+	memcpy(&mSamples[0], samples + first, (written - first) * sizeof(float));
+	//Release so the consumer sees the samples before it sees the new tail
+	mTail.store(tail + written, std::memory_order_release);
+	return written;
+}
+
+void AudioStream::Read(float* out, size_t count)
+{
+	const size_t head = mHead.load(std::memory_order_relaxed);
+	const size_t read = std::min(count, mTail.load(std::memory_order_acquire) - head);
+
+	const size_t start = head & (mCapacity - 1u);
+	const size_t first = std::min(read, mCapacity - start);
+	memcpy(out, &mSamples[start], first * sizeof(float));
+	memcpy(out + first, &mSamples[0], (read - first) * sizeof(float));
+	//Release so the producer only reuses the samples after they were read
+	mHead.store(head + read, std::memory_order_release);
+	mHead.notify_one();
+
+	if (read > 0)
+		mLastSample = out[read - 1u];
+	if (read < count)
+	{
+		std::fill(out + read, out + count, mLastSample);
+		++mUnderruns;
+		mUnderrunSamples += count - read;
+	}
+}
+
+void AudioStream::WaitForFill(size_t fill) const
+{
+	//Only the producer moves the tail, so it can't change while waiting here
+	const size_t tail = mTail.load(std::memory_order_relaxed);
+	for (size_t head = mHead.load(std::memory_order_acquire); tail - head > fill; head = mHead.load(std::memory_order_acquire))
+		mHead.wait(head, std::memory_order_acquire);
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <cstddef>
+#include "SathwareEngine.h"
+
+//Lock free single producer single consumer ring of mono float samples between an emulator and an audio backend (Audio or NullAudio)
+//Write may only be called from the emulation thread and Read only from the backend's thread
+class SathwareAPI AudioStream
+{
+public:
+	//latencyMs is how much audio the backend keeps queued for playback, the ring itself holds 4 times that
+	AudioStream(unsigned int sampleRate, unsigned int latencyMs);
+
+	unsigned int GetSampleRate() const
+	{
+		return mSampleRate;
+	}
+	//Samples the backend keeps queued, backends split it into their submit buffers
+	size_t GetLatencySamples() const
+	{
+		return mLatencySamples;
+	}
+	size_t GetCapacity() const
+	{
+		return mCapacity;
+	}
+
+	//Emulation thread, append samples, whatever doesn't fit is dropped and counted as an overrun, returns the number written
+	size_t Write(const float* samples, size_t count);
+	//Backend thread, take count samples, if there aren't enough the rest is filled with the last sample and counted as an underrun
+	void Read(float* out, size_t count);
+	//Number of buffered samples, only exact when called from the producer or consumer thread
+	size_t GetFill() const
+	{
+		return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+	}
+	//Emulation thread, sleep until the backend has played the buffer down to at most fill samples
+	void WaitForFill(size_t fill) const;
+
+	/* Stats */
+	//Reads that came up short, and the samples that were missing
+	unsigned int GetUnderruns() const
+	{
+		return mUnderruns;
+	}
+	unsigned __int64 GetUnderrunSamples() const
+	{
+		return mUnderrunSamples;
+	}
+	//Writes that didn't fit, and the samples that were dropped
+	unsigned int GetOverruns() const
+	{
+		return mOverruns;
+	}
+	unsigned __int64 GetOverrunSamples() const
+	{
+		return mOverrunSamples;
+	}
+
+	AudioStream(const AudioStream& other) = delete;
+	AudioStream(const AudioStream&& other) = delete;
+	AudioStream& operator=(const AudioStream& other) = delete;
+private:
+	unsigned int mSampleRate;
+	size_t mLatencySamples;
+	//Power of two so positions wrap with a mask
+	size_t mCapacity;
+	std::unique_ptr<float[]> mSamples;
+	//Repeated on underruns so a late producer doesn't click back to zero
+	float mLastSample = 0.0f;
+
+	//Head and tail are written by different threads, keep them on separate cache lines
+	alignas(64) std::atomic<size_t> mHead = 0;
+	alignas(64) std::atomic<size_t> mTail = 0;
+
+	//Underruns are written by the backend thread, overruns by the emulation thread
+	std::atomic<unsigned int> mUnderruns = 0;
+	std::atomic<unsigned __int64> mUnderrunSamples = 0;
+	std::atomic<unsigned int> mOverruns = 0;
+	std::atomic<unsigned __int64> mOverrunSamples = 0;
+};
@@ -0,0 +1,122 @@
+#include "CRC32.h"
+#include <intrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#include <array>
+#include <cstring>
+
+//Bit reversed CRC-32 polynomial
+static constexpr unsigned __int32 polynomial = 0xedb88320u;
+
+//Slicing by 8 tables, tables[k][b] is the CRC of byte b followed by k zero bytes
+static constexpr std::array<std::array<unsigned __int32, 256u>, 8u> MakeTables()
+{
+	std::array<std::array<unsigned __int32, 256u>, 8u> tables{};
+	for (unsigned __int32 b = 0; b < 256u; ++b)
+	{
+		unsigned __int32 crc = b;
+		for (unsigned int bit = 0; bit < 8u; ++bit)
+			crc = (crc >> 1u) ^ ((crc & 1u) ? polynomial : 0);
+		tables[0][b] = crc;
+	}
+	for (unsigned int k = 1u; k < 8u; ++k)
+	{
+		for (unsigned int b = 0; b < 256u; ++b)
+			tables[k][b] = (tables[k - 1u][b] >> 8u) ^ tables[0][tables[k - 1u][b] & 0xffu];
+	}
+	return tables;
+}
+static constexpr std::array<std::array<unsigned __int32, 256u>, 8u> tables = MakeTables();
+
+//8 bytes per step, for CPUs without carry-less multiply and for the tail the folding can't take
+static unsigned __int32 CRC32Sliced(const unsigned __int8* data, size_t size, unsigned __int32 crc)
+{
+	for (; size >= 8u; data += 8u, size -= 8u)
+	{
+		unsigned __int32 low, high;
+		memcpy(&low, data, 4u);
+		memcpy(&high, data + 4u, 4u);
+		low ^= crc;
+		crc = tables[7][low & 0xffu] ^ tables[6][(low >> 8u) & 0xffu] ^ tables[5][(low >> 16u) & 0xffu] ^ tables[4][low >> 24u]
+			^ tables[3][high & 0xffu] ^ tables[2][(high >> 8u) & 0xffu] ^ tables[1][(high >> 16u) & 0xffu] ^ tables[0][high >> 24u];
+	}
+	for (; size > 0; ++data, --size)
+		crc = tables[0][(crc ^ *data) & 0xffu] ^ (crc >> 8u);
+	return crc;
+}
+
+//Folds 64 bytes per step with carry-less multiplies, then Barrett reduces to 32 bits. size has to be at least 64 and a multiple of 16
+//Source: "https://www.intel.com/content/dam/www/public/us/en/documents/white-papers/fast-crc-computation-generic-polynomials-pclmulqdq-paper.pdf"
+static unsigned __int32 CRC32Folded(const unsigned __int8* data, size_t size, unsigned __int32 crc)
+{
+	//x^(4*128+32) mod P and x^(4*128-32) mod P folds 4 blocks ahead, then the same for 1 block ahead, x^64 mod P and the Barrett constants, all bit reflected
+	alignas(16) static constexpr unsigned __int64 fold4[2] = { 0x0154442bd4ull, 0x01c6e41596ull };
+	alignas(16) static constexpr unsigned __int64 fold1[2] = { 0x01751997d0ull, 0x00ccaa009eull };
+	alignas(16) static constexpr unsigned __int64 fold64[2] = { 0x0163cd6124ull, 0 };
+	alignas(16) static constexpr unsigned __int64 barrett[2] = { 0x01db710641ull, 0x01f7011641ull };
+
+	auto fold = [](__m128i block, __m128i constants, __m128i next)
+	{
+		return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(block, constants, 0x00), _mm_clmulepi64_si128(block, constants, 0x11)), next);
+	};
+
+	__m128i x0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), _mm_cvtsi32_si128((int)crc));
+	__m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16u));
+	__m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32u));
+	__m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48u));
+	data += 64u;
+	size -= 64u;
+
+	//4 independent chains keep the multiplier busy
+	__m128i constants = _mm_load_si128(reinterpret_cast<const __m128i*>(fold4));
+	for (; size >= 64u; data += 64u, size -= 64u)
+	{
+		x0 = fold(x0, constants, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+		x1 = fold(x1, constants, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16u)));
+		x2 = fold(x2, constants, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 32u)));
+		x3 = fold(x3, constants, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 48u)));
+	}
+
+	constants = _mm_load_si128(reinterpret_cast<const __m128i*>(fold1));
+	x0 = fold(x0, constants, x1);
+	x0 = fold(x0, constants, x2);
+	x0 = fold(x0, constants, x3);
+	for (; size >= 16u; data += 16u, size -= 16u)
+		x0 = fold(x0, constants, _mm_loadu_si128(reinterpret_cast<const __m128i*>(data)));
+
+	//128 bits to 64
+	const __m128i low32 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x0 = _mm_xor_si128(_mm_srli_si128(x0, 8), _mm_clmulepi64_si128(x0, constants, 0x10));
+	constants = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(fold64));
+	x0 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x0, low32), constants, 0x00), _mm_srli_si128(x0, 4));
+
+	//64 bits to 32
+	constants = _mm_load_si128(reinterpret_cast<const __m128i*>(barrett));
+	__m128i quotient = _mm_and_si128(_mm_clmulepi64_si128(_mm_and_si128(x0, low32), constants, 0x10), low32);
+	x0 = _mm_xor_si128(x0, _mm_clmulepi64_si128(quotient, constants, 0x00));
+	return (unsigned __int32)_mm_extract_epi32(x0, 1);
+}
+
+static bool HasCarrylessMultiply()
+{
+	//PCLMULQDQ is bit 1 and SSE4.1 bit 19 of ECX
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 1)) != 0 && (info[2] & (1 << 19)) != 0;
+}
+
+unsigned __int32 CRC32(const void* data, size_t size, unsigned __int32 crc)
+{
+	static const bool folded = HasCarrylessMultiply();
+
+	const unsigned __int8* bytes = static_cast<const unsigned __int8*>(data);
+	crc = ~crc;
+	if (folded && size >= 64u)
+	{
+		const size_t foldedSize = size & ~(size_t)15u;
+		crc = CRC32Folded(bytes, foldedSize, crc);
+		bytes += foldedSize;
+		size -= foldedSize;
+	}
+	return ~CRC32Sliced(bytes, size, crc);
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+#include "SathwareEngine.h"
+
+//CRC-32 as used by zip files and ROM databases, Source: "https://en.wikipedia.org/wiki/Cyclic_redundancy_check"
+//Pass the result of a previous call as crc to continue the CRC over more data
+SathwareAPI unsigned __int32 CRC32(const void* data, size_t size, unsigned __int32 crc = 0);
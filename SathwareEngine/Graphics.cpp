@@ -12,11 +12,18 @@
 #include <dxgi1_6.h>
 #include <d3dcompiler.h>
 #include <d3d11sdklayers.h>
+#include <utility>
 
 Graphics::Graphics(const DesktopWindow& window)
-	: m_width(window.mClientWidth), m_height(window.mClientHeight), 
-	frameImage(new Color[m_width*m_height])
+	: m_width(window.mClientWidth), m_height(window.mClientHeight)
 {
+	for (unsigned int slot = 0; slot < 3u; ++slot)
+	{
+		mFrameSlots[slot] = std::make_unique<Color[]>(m_width * m_height);
+		mRowHashes[slot] = std::make_unique<unsigned __int64[]>(m_height);
+	}
+	mTextureRowHashes = std::make_unique<unsigned __int64[]>(m_height);
+
 	InitializeDeviceAndContext();
 	InitializeSwapChain(window.m_windowHandle);
 	InitializeRenderTarget();
@@ -297,13 +304,14 @@ void Graphics::InitializePixelShaderTexture()
 	textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	textureDesc.SampleDesc.Count = 1;
 	textureDesc.SampleDesc.Quality = 0;
-	textureDesc.Usage = D3D11_USAGE_DYNAMIC;
+	//Default usage so single rows can be updated, a dynamic texture has to be rewritten completely on every map
+	textureDesc.Usage = D3D11_USAGE_DEFAULT;
 	textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-	textureDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	textureDesc.CPUAccessFlags = 0;
 	textureDesc.MiscFlags = 0;
 
 	D3D11_SUBRESOURCE_DATA resource{};
-	resource.pSysMem = frameImage;
+	resource.pSysMem = mFrameSlots[mFrontSlot].get();
 	resource.SysMemPitch = (UINT)m_width * sizeof(Color);
 	resource.SysMemSlicePitch = 0;
 
@@ -334,39 +342,150 @@ void Graphics::InitializePixelShaderTexture()
 	ThrowIfFailed(result, L"Failed to create Sampler for texture!");
 }
 
+Graphics::~Graphics()
+{
+	StopPresenter();
+}
+
 void Graphics::ClearBuffer()
 {
-	memset(reinterpret_cast<char*>(frameImage), 0x00000000, m_width * m_height);
+	memset(reinterpret_cast<char*>(mFrameSlots[mBackSlot].get()), 0x00000000, m_width * m_height * sizeof(Color));
 	/*for (size_t i = 0; i < m_width * m_height; ++i)
 		frameImage[i].rgba = 0x00000000;*/
 }
 
-void Graphics::UpdateFrame()
+size_t Graphics::UpdateFrame()
 {
-	D3D11_MAPPED_SUBRESOURCE mappedResource{};
-	HRESULT result = mContext->Map(mShaderTexture.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedResource);
-	ThrowIfFailed(result, L"Mapping texture buffer for CPU write failed!");
+	const Color* frameImage = mFrameSlots[mFrontSlot].get();
+	const unsigned __int64* rowHashes = mRowHashes[mFrontSlot].get();
+	auto rowChanged = [&](size_t y) { return !mTextureValid || rowHashes[y] != mTextureRowHashes[y]; };
 
-	Color* d3dTexture = reinterpret_cast<Color*>(mappedResource.pData);
-	size_t scanLineWidth = mappedResource.RowPitch / sizeof(Color);
-
-	for (size_t y = 0; y < m_height; ++y)
+	//Upload each run of changed rows with one copy
+	size_t rowsUploaded = 0;
+	for (size_t y = 0; y < m_height;)
 	{
-		memcpy(&d3dTexture[y * scanLineWidth], &frameImage[y * m_width], m_width * sizeof(Color));
+		if (!rowChanged(y))
+		{
+			++y;
+			continue;
+		}
+
+		const size_t firstRow = y;
+		for (; y < m_height && rowChanged(y); ++y)
+			mTextureRowHashes[y] = rowHashes[y];
+
+		D3D11_BOX rows{};
+		rows.left = 0;
+		rows.right = (UINT)m_width;
+		rows.top = (UINT)firstRow;
+		rows.bottom = (UINT)y;
+		rows.front = 0;
+		rows.back = 1;
+		mContext->UpdateSubresource(mShaderTexture.Get(), 0, &rows, &frameImage[firstRow * m_width], (UINT)(m_width * sizeof(Color)), 0);
+		rowsUploaded += y - firstRow;
 	}
+	mTextureValid = true;
 
-	mContext->Unmap(mShaderTexture.Get(), 0);
+	mRowsUploaded += rowsUploaded;
+	mRowsSkipped += m_height - rowsUploaded;
+	return rowsUploaded;
 }
 
-void Graphics::Render()
+void Graphics::PresentFrontSlot()
 {
+	//The swap chain still shows the last frame, nothing to do if it is the same
+	if (UpdateFrame() == 0)
+	{
+		++mFramesSkipped;
+		return;
+	}
+
 	const float clearColor[4] = { 0.1843f, 0.207f, 0.235f, 1.0f };
 	mContext->ClearRenderTargetView(mRenderTargetView.Get(), clearColor);
 	mContext->OMSetRenderTargets(1, mRenderTargetView.GetAddressOf(), nullptr);
 
-	UpdateFrame();
-
 	mContext->Draw(numVertices, 0);
 	HRESULT result = mSwapChain->Present(1, 0);
 	ThrowIfFailed(result, L"Presenting Frame failed!");
-}
\ No newline at end of file
+}
+
+void Graphics::PublishFrame()
+{
+	if (mPresenterFailed.load(std::memory_order_acquire))
+		RethrowPresenterError();
+
+	//Hashed here so the presenter only has to compare
+	const Color* frame = mFrameSlots[mBackSlot].get();
+	unsigned __int64* rowHashes = mRowHashes[mBackSlot].get();
+	for (size_t y = 0; y < m_height; ++y)
+		rowHashes[y] = HashRow(&frame[y * m_width], m_width);
+
+	//The old ready slot is either stale or was never presented, either way the producer can draw over it
+	mBackSlot = mReadySlot.exchange(mBackSlot | readySlotFresh) & ~readySlotFresh;
+
+	if (mPresenter.joinable())
+	{
+		++mPublishCount;
+		mPublishCount.notify_one();
+	}
+	else
+		PresentLatest();
+}
+
+bool Graphics::PresentLatest()
+{
+	if ((mReadySlot.load() & readySlotFresh) == 0)
+		return false;
+
+	mFrontSlot = mReadySlot.exchange(mFrontSlot) & ~readySlotFresh;
+	PresentFrontSlot();
+	return true;
+}
+
+void Graphics::StartPresenter()
+{
+	if (mPresenter.joinable())
+		return;
+
+	mPresenting = true;
+	mPresenter = std::thread(&Graphics::PresenterThread, this);
+}
+
+void Graphics::StopPresenter()
+{
+	if (!mPresenter.joinable())
+		return;
+
+	mPresenting = false;
+	++mPublishCount;
+	mPublishCount.notify_one();
+	mPresenter.join();
+}
+
+void Graphics::PresenterThread()
+{
+	try
+	{
+		while (mPresenting)
+		{
+			const unsigned int publishCount = mPublishCount.load();
+			//Sleep until the producer publishes something new
+			if (!PresentLatest())
+				mPublishCount.wait(publishCount);
+		}
+	}
+	//Device removed and the like, the producer throws it on its next frame
+	catch (...)
+	{
+		mPresenterError = std::current_exception();
+		mPresenting = false;
+		mPresenterFailed.store(true, std::memory_order_release);
+	}
+}
+
+void Graphics::RethrowPresenterError()
+{
+	mPresenter.join();
+	mPresenterFailed = false;
+	std::rethrow_exception(std::exchange(mPresenterError, nullptr));
+}
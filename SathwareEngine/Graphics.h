@@ -5,24 +5,71 @@
 #include <fstream>
 #include <filesystem>
 #include "Color.h"
+#include "VideoSink.h"
 #include <vector>
+#include <memory>
+#include <atomic>
+#include <exception>
+#include <thread>
 #include "SathwareEngine.h"
 
-class SathwareAPI Graphics
+class SathwareAPI Graphics : public VideoSink
 {
 public:
 	Graphics(const class DesktopWindow& window);
+	~Graphics() override;
 	void ClearBuffer();
-	void Render();
+	//Publish the frame drawn with PutPixel, same as PublishFrame
+	void Render()
+	{
+		PublishFrame();
+	}
 
 	void PutPixel(unsigned __int32 x, unsigned __int32 y, Color c)
 	{
 		assert(x >= 0 && x < m_width);
 		assert(y >= 0 && y < m_height);
 
-		frameImage[m_width * y + x] = c;
+		mFrameSlots[mBackSlot][m_width * y + x] = c;
 	}
 
+	/* Frame handoff, frames are triple buffered so neither the producer nor the presenter ever wait on each other */
+	size_t GetWidth() const override
+	{
+		return m_width;
+	}
+	size_t GetHeight() const override
+	{
+		return m_height;
+	}
+	//Producer thread only, the m_width * m_height frame to draw the next frame into, stays the same until PublishFrame
+	//Throws what stopped the presenter thread, if it stopped
+	Color* AcquireFrame() override
+	{
+		if (mPresenterFailed.load(std::memory_order_acquire))
+			RethrowPresenterError();
+		return mFrameSlots[mBackSlot].get();
+	}
+	//Producer thread only, hand the acquired frame to the presenter, frames that are never presented are dropped
+	//Without a presenter thread the frame is presented immediately on the calling thread, throws what stopped the presenter thread, if it stopped
+	void PublishFrame() override;
+	//Present frames on their own thread so waiting on vsync doesn't stall the producer, all Direct3D calls happen on that thread until StopPresenter
+	void StartPresenter();
+	void StopPresenter();
+
+	/* Stats, rows and frames that didn't change since the last upload are skipped */
+	unsigned __int64 GetRowsUploaded() const
+	{
+		return mRowsUploaded;
+	}
+	unsigned __int64 GetRowsSkipped() const
+	{
+		return mRowsSkipped;
+	}
+	unsigned __int64 GetFramesSkipped() const
+	{
+		return mFramesSkipped;
+	}
 	size_t m_width;
 	size_t m_height;
 
@@ -42,7 +89,15 @@ private:
 	void InitializeInputLayout();
 	void InitializeVertexBuffer();
 	void InitializePixelShaderTexture();
-	void UpdateFrame();
+	//Upload the rows of the front slot that differ from the texture, returns the number of rows uploaded
+	size_t UpdateFrame();
+	//Upload the front slot and present it, identical frames are not presented again
+	void PresentFrontSlot();
+	//Presenter thread only, swap in the ready slot and present it if it holds a new frame
+	bool PresentLatest();
+	void PresenterThread();
+	//Producer thread, join the failed presenter thread and throw its error here instead
+	void RethrowPresenterError();
 
 	ComPtr<ID3D11Device> mDevice;
 	ComPtr<ID3D11DeviceContext> mContext;
@@ -76,7 +131,30 @@ private:
 
 	unsigned int numVertices;
 
-	Color* frameImage;
+	//Triple buffered frames, the producer draws into the back slot, the presenter reads the front slot
+	//and the ready slot holds the newest finished frame, slots change owner by swapping indexes
+	std::unique_ptr<Color[]> mFrameSlots[3];
+	unsigned int mBackSlot = 0;
+	unsigned int mFrontSlot = 1;
+	//Index of the ready slot, or'd with readySlotFresh when it holds a frame that hasn't been presented yet
+	std::atomic<unsigned int> mReadySlot = 2;
+	static constexpr unsigned int readySlotFresh = 0x4u;
+	//Hash of every row of each slot, filled in by PublishFrame and moving between threads with the slot
+	std::unique_ptr<unsigned __int64[]> mRowHashes[3];
+	//Presenter thread only, hashes of the rows currently in mShaderTexture
+	std::unique_ptr<unsigned __int64[]> mTextureRowHashes;
+	bool mTextureValid = false;
+	std::atomic<unsigned __int64> mRowsUploaded = 0;
+	std::atomic<unsigned __int64> mRowsSkipped = 0;
+	std::atomic<unsigned __int64> mFramesSkipped = 0;
+
+	std::thread mPresenter;
+	std::atomic<bool> mPresenting = false;
+	//Bumped on every publish so the presenter can sleep on it
+	std::atomic<unsigned int> mPublishCount = 0;
+	//An exception escaping the presenter thread would terminate the program, it is kept here for the producer to throw
+	std::exception_ptr mPresenterError;
+	std::atomic<bool> mPresenterFailed = false;
 
 	struct Vertex
 	{
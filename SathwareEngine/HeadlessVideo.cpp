@@ -0,0 +1,174 @@
+#include "HeadlessVideo.h"
+#include <string>
+
+HeadlessVideo::HeadlessVideo(size_t width, size_t height)
+	: mWidth(width), mHeight(height), mJobs(std::make_unique<WriteJob[]>(numJobs))
+{
+	for (std::unique_ptr<Color[]>& frame : mFrames)
+		frame = std::make_unique<Color[]>(mWidth * mHeight);
+
+	for (unsigned int i = 0; i < numJobs; ++i)
+		mFreeJobs.Push(&mJobs[i]);
+
+	mWriter = std::thread(&HeadlessVideo::WriterThread, this);
+}
+
+HeadlessVideo::~HeadlessVideo()
+{
+	//The writer drains every queued job before it exits
+	mWriting = false;
+	++mSubmitCount;
+	mSubmitCount.notify_one();
+	mWriter.join();
+}
+
+void HeadlessVideo::PublishFrame()
+{
+	const size_t numPixels = mWidth * mHeight;
+	const unsigned __int8* frameBytes = reinterpret_cast<const unsigned __int8*>(mFrames[mBackFrame].get());
+
+	auto request = mPPMRequests.find(mFrameCount);
+	if (request != mPPMRequests.end())
+	{
+		WriteJob* job = AcquireJob();
+		job->JobKind = WriteJob::Kind::PPM;
+		job->File = request->second;
+		job->Data.assign(frameBytes, frameBytes + numPixels * sizeof(Color));
+		SubmitJob(job);
+		mPPMRequests.erase(request);
+	}
+
+	if (mRawFormat != RawFormat::None)
+	{
+		WriteJob* job = AcquireJob();
+		job->JobKind = WriteJob::Kind::Raw;
+		job->File.clear();
+		//Job buffers keep their capacity, so after the first few frames this is only a copy
+		if (mRawFormat == RawFormat::RGBA)
+			job->Data.assign(frameBytes, frameBytes + numPixels * sizeof(Color));
+		else
+			job->Data.assign(mIndexedFrame.get(), mIndexedFrame.get() + numPixels);
+		SubmitJob(job);
+	}
+
+	mBackFrame ^= 1u;
+	++mFrameCount;
+}
+
+void HeadlessVideo::RequestPPM(unsigned __int64 frameNumber, const std::filesystem::path& file)
+{
+	mPPMRequests[frameNumber] = file;
+}
+
+void HeadlessVideo::OpenRawStream(const std::filesystem::path& file, RawFormat format)
+{
+	CloseRawStream();
+	if (format == RawFormat::None)
+		return;
+
+	mRawStream.open(file, std::ios_base::binary | std::ios_base::trunc);
+	if (!mRawStream.is_open())
+		throw Exception(L"Failed to open raw frame stream!");
+
+	if (format == RawFormat::Indexed && mIndexedFrame == nullptr)
+		mIndexedFrame = std::make_unique<unsigned __int8[]>(mWidth * mHeight);
+	mRawFormat = format;
+}
+
+void HeadlessVideo::CloseRawStream()
+{
+	if (mRawFormat == RawFormat::None)
+		return;
+
+	//The writer owns the stream until every frame queued for it is written
+	Flush();
+	mRawStream.close();
+	mRawFormat = RawFormat::None;
+}
+
+void HeadlessVideo::Flush()
+{
+	const unsigned int submitCount = mSubmitCount.load();
+	unsigned int completedCount = mCompletedCount.load();
+	while (completedCount != submitCount)
+	{
+		mCompletedCount.wait(completedCount);
+		completedCount = mCompletedCount.load();
+	}
+}
+
+HeadlessVideo::WriteJob* HeadlessVideo::AcquireJob()
+{
+	WriteJob* job = nullptr;
+	if (mFreeJobs.Pop(job))
+		return job;
+
+	++mWriterStalls;
+	while (true)
+	{
+		const unsigned int completedCount = mCompletedCount.load();
+		if (mFreeJobs.Pop(job))
+			return job;
+		mCompletedCount.wait(completedCount);
+	}
+}
+
+void HeadlessVideo::SubmitJob(WriteJob* job)
+{
+	//Can't fail, there are never more jobs in flight than the queue holds
+	mPendingJobs.Push(job);
+	++mSubmitCount;
+	mSubmitCount.notify_one();
+}
+
+void HeadlessVideo::WriterThread()
+{
+	while (true)
+	{
+		const unsigned int submitCount = mSubmitCount.load();
+		WriteJob* job = nullptr;
+		if (mPendingJobs.Pop(job))
+		{
+			if (job->JobKind == WriteJob::Kind::PPM)
+				WritePPM(*job);
+			else if (!mRawStream.write(reinterpret_cast<const char*>(job->Data.data()), job->Data.size()))
+				++mWriteErrors;
+
+			mFreeJobs.Push(job);
+			++mCompletedCount;
+			mCompletedCount.notify_all();
+		}
+		else if (!mWriting)
+			return;
+		else
+		{
+			//Sleep until the producer submits something new
+			mSubmitCount.wait(submitCount);
+		}
+	}
+}
+
+//Source: "https://netpbm.sourceforge.net/doc/ppm.html"
+void HeadlessVideo::WritePPM(const WriteJob& job)
+{
+	std::ofstream file(job.File, std::ios_base::binary | std::ios_base::trunc);
+	if (!file.is_open())
+	{
+		++mWriteErrors;
+		return;
+	}
+
+	const std::string header = "P6\n" + std::to_string(mWidth) + " " + std::to_string(mHeight) + "\n255\n";
+	file.write(header.data(), header.size());
+
+	//PPM has no alpha, drop every 4th byte
+	std::vector<char> rgb(mWidth * mHeight * 3u);
+	for (size_t pixel = 0; pixel < mWidth * mHeight; ++pixel)
+	{
+		rgb[pixel * 3u + 0u] = job.Data[pixel * sizeof(Color) + 0u];
+		rgb[pixel * 3u + 1u] = job.Data[pixel * sizeof(Color) + 1u];
+		rgb[pixel * 3u + 2u] = job.Data[pixel * sizeof(Color) + 2u];
+	}
+	if (!file.write(rgb.data(), rgb.size()))
+		++mWriteErrors;
+}
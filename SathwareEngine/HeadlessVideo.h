@@ -0,0 +1,129 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include "VideoSink.h"
+#include "SPSCQueue.h"
+#include "SathwareException.h"
+#include "SathwareEngine.h"
+
+//Video sink without a window, keeps the last published frame in memory and can dump frames to disk
+//All file writes happen on a writer thread, frames are copied once on the producer thread and written from the copy
+class SathwareAPI HeadlessVideo : public VideoSink
+{
+public:
+	enum class RawFormat
+	{
+		None,
+		//4 bytes per pixel, same layout as Color
+		RGBA,
+		//1 byte per pixel, only producers that fill AcquireIndexedFrame can write it
+		Indexed
+	};
+
+	HeadlessVideo(size_t width, size_t height);
+	~HeadlessVideo() override;
+
+	size_t GetWidth() const override
+	{
+		return mWidth;
+	}
+	size_t GetHeight() const override
+	{
+		return mHeight;
+	}
+	Color* AcquireFrame() override
+	{
+		return mFrames[mBackFrame].get();
+	}
+	unsigned __int8* AcquireIndexedFrame() override
+	{
+		return mRawFormat == RawFormat::Indexed ? mIndexedFrame.get() : nullptr;
+	}
+	void PublishFrame() override;
+
+	//The last published frame, valid until the next PublishFrame
+	const Color* GetLastFrame() const
+	{
+		return mFrames[mBackFrame ^ 1u].get();
+	}
+	//Number of frames published so far, the next published frame has this number
+	unsigned __int64 GetFrameCount() const
+	{
+		return mFrameCount;
+	}
+
+	/* Dumping */
+	//Save the frame with the given number as a binary PPM once it is published
+	void RequestPPM(unsigned __int64 frameNumber, const std::filesystem::path& file);
+	//Append every frame from now on to file, frames are stored back to back without any header
+	void OpenRawStream(const std::filesystem::path& file, RawFormat format);
+	void CloseRawStream();
+	//Wait until every queued write reached the disk
+	void Flush();
+	//Number of times the producer had to wait because all write buffers were queued
+	unsigned int GetWriterStalls() const
+	{
+		return mWriterStalls;
+	}
+	//Number of dumps that could not be written
+	unsigned int GetWriteErrors() const
+	{
+		return mWriteErrors;
+	}
+
+	HeadlessVideo(const HeadlessVideo& other) = delete;
+	HeadlessVideo(const HeadlessVideo&& other) = delete;
+	HeadlessVideo& operator=(const HeadlessVideo& other) = delete;
+private:
+	struct WriteJob
+	{
+		enum class Kind
+		{
+			PPM,
+			Raw
+		} JobKind;
+		std::filesystem::path File;
+		std::vector<unsigned __int8> Data;
+	};
+
+	//Get a free job, waits for the writer if there is none
+	WriteJob* AcquireJob();
+	void SubmitJob(WriteJob* job);
+	void WriterThread();
+	void WritePPM(const WriteJob& job);
+
+	size_t mWidth;
+	size_t mHeight;
+	//Double buffered, the producer draws into the back frame while the front frame stays readable
+	std::unique_ptr<Color[]> mFrames[2];
+	unsigned int mBackFrame = 0;
+	std::unique_ptr<unsigned __int8[]> mIndexedFrame;
+	unsigned __int64 mFrameCount = 0;
+
+	std::map<unsigned __int64, std::filesystem::path> mPPMRequests;
+	RawFormat mRawFormat = RawFormat::None;
+	//Writer thread only while the stream is open
+	std::ofstream mRawStream;
+
+	//Jobs are owned here and cycle between the free queue and the writer thread
+	static constexpr unsigned int numJobs = 16u;
+	std::unique_ptr<WriteJob[]> mJobs;
+	//Writer thread -> producer
+	SPSCQueue<WriteJob*, numJobs> mFreeJobs;
+	//Producer -> writer thread
+	SPSCQueue<WriteJob*, numJobs> mPendingJobs;
+
+	std::thread mWriter;
+	std::atomic<bool> mWriting = true;
+	//Bumped on every submit so the writer thread can sleep on it
+	std::atomic<unsigned int> mSubmitCount = 0;
+	//Bumped on every finished job so the producer can sleep on it
+	std::atomic<unsigned int> mCompletedCount = 0;
+	unsigned int mWriterStalls = 0;
+	std::atomic<unsigned int> mWriteErrors = 0;
+};
@@ -0,0 +1,70 @@
+#include "MappedFile.h"
+#include <Windows.h>
+
+MappedFile::MappedFile(const std::filesystem::path& file)
+	: mWritable(false)
+{
+	Map(file, 0);
+}
+
+MappedFile::MappedFile(const std::filesystem::path& file, size_t size, Writes writes)
+	: mWritable(true), mPrivate(writes == Writes::PrivateCopy)
+{
+	Map(file, size);
+}
+
+MappedFile::~MappedFile()
+{
+	UnmapViewOfFile(mpData);
+	CloseHandle(mMapping);
+	CloseHandle(mFile);
+}
+
+void MappedFile::Flush()
+{
+	//FlushViewOfFile only starts the writes, FlushFileBuffers waits for them
+	if (mWritable && !mPrivate && FlushViewOfFile(mpData, 0))
+		FlushFileBuffers(mFile);
+}
+
+void MappedFile::Map(const std::filesystem::path& file, size_t size)
+{
+	//Private copies only read the file, so they have to let its writer keep writing
+	if (mPrivate)
+		mFile = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	else
+		mFile = mWritable ? CreateFileW(file.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr)
+			: CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)
+		throw Exception(L"Failed to open " + file.wstring());
+
+	if (size == 0 || mPrivate)
+	{
+		LARGE_INTEGER fileSize;
+		//Empty files can't be mapped, and a private copy can't grow the file
+		if (!GetFileSizeEx(mFile, &fileSize) || fileSize.QuadPart == 0 || (size_t)fileSize.QuadPart < size)
+		{
+			CloseHandle(mFile);
+			throw Exception(L"Failed to get the size of " + file.wstring());
+		}
+		mSize = size != 0 ? size : (size_t)fileSize.QuadPart;
+	}
+	else
+		mSize = size;
+
+	//A writable mapping larger than the file grows the file
+	if (mPrivate)
+		mMapping = CreateFileMappingW(mFile, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	else
+		mMapping = mWritable ? CreateFileMappingW(mFile, nullptr, PAGE_READWRITE, (DWORD)((unsigned __int64)mSize >> 32u), (DWORD)mSize, nullptr)
+			: CreateFileMappingW(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping != nullptr)
+		mpData = static_cast<unsigned __int8*>(MapViewOfFile(mMapping, mPrivate ? FILE_MAP_COPY : (mWritable ? FILE_MAP_WRITE : FILE_MAP_READ), 0, 0, mSize));
+	if (mpData == nullptr)
+	{
+		if (mMapping != nullptr)
+			CloseHandle(mMapping);
+		CloseHandle(mFile);
+		throw Exception(L"Failed to map " + file.wstring());
+	}
+}
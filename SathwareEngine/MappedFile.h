@@ -0,0 +1,56 @@
+#pragma once
+#include <filesystem>
+#include "SathwareException.h"
+#include "SathwareEngine.h"
+
+//Memory maps a whole file. The OS loads each page the first time it is touched, and every mapping of the file shares those pages
+//Nothing is copied, so a large file, or one loaded many times, costs no more memory than the one copy in the file cache
+class SathwareAPI MappedFile
+{
+public:
+	//Where writes to a writable mapping go
+	enum class Writes
+	{
+		//Into the file, which is created or grown to size bytes first, new bytes are 0. Nobody else can open the file for writing meanwhile
+		Exclusive,
+		//Into a copy of the pages only this mapping sees, the file has to exist and hold size bytes but may be open for writing elsewhere
+		PrivateCopy
+	};
+
+	//Map an existing file read only
+	MappedFile(const std::filesystem::path& file);
+	//Map size bytes of a file for reading and writing
+	MappedFile(const std::filesystem::path& file, size_t size, Writes writes = Writes::Exclusive);
+	~MappedFile();
+
+	const unsigned __int8* GetData() const
+	{
+		return mpData;
+	}
+	//nullptr for read only mappings
+	unsigned __int8* GetWritableData()
+	{
+		return mWritable ? mpData : nullptr;
+	}
+	size_t GetSize() const
+	{
+		return mSize;
+	}
+	//Write modified pages back to the file and wait until the disk has them, does nothing for private copies
+	void Flush();
+
+	MappedFile(const MappedFile& other) = delete;
+	MappedFile(const MappedFile&& other) = delete;
+	MappedFile& operator=(const MappedFile& other) = delete;
+private:
+	//size 0 maps the whole file
+	void Map(const std::filesystem::path& file, size_t size);
+
+	bool mWritable;
+	bool mPrivate = false;
+	//Windows HANDLEs, kept as void* so Windows.h stays out of the header
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+	unsigned __int8* mpData = nullptr;
+	size_t mSize = 0;
+};
@@ -0,0 +1,53 @@
+#include "NullAudio.h"
+#include "AVCapture.h"
+#include <algorithm>
+#include <chrono>
+
+NullAudio::NullAudio(AudioStream& stream, const std::filesystem::path& wavFile)
+	: Stream(stream), mBufferSamples(std::max<size_t>(stream.GetLatencySamples() / 3u, 1u)),
+	mBuffer(std::make_unique<float[]>(mBufferSamples))
+{
+	if (!wavFile.empty())
+	{
+		mWAVFile.open(wavFile, std::ios_base::binary | std::ios_base::trunc);
+		if (!mWAVFile.is_open())
+			throw Exception(L"Failed to open audio output file!");
+		//Chunk sizes are filled in again once playback stops
+		AVCapture::WriteWAVHeader(mWAVFile, Stream.GetSampleRate(), 0);
+	}
+
+	mPlayback = std::thread(&NullAudio::PlaybackThread, this);
+}
+
+NullAudio::~NullAudio()
+{
+	mPlaying = false;
+	mPlayback.join();
+	if (mWAVFile.is_open())
+		AVCapture::WriteWAVHeader(mWAVFile, Stream.GetSampleRate(), mPlayedSamples);
+}
+
+void NullAudio::PlaybackThread()
+{
+	//Take a buffer every time a real device would have finished playing one, deadlines are absolute so sleep overshoot doesn't add up
+	const std::chrono::duration<double> bufferDuration(double(mBufferSamples) / Stream.GetSampleRate());
+	auto deadline = std::chrono::steady_clock::now();
+	//Like Audio, the first buffers play silence while the producer gets going
+	unsigned int silentBuffers = 3u;
+	while (mPlaying)
+	{
+		deadline += std::chrono::duration_cast<std::chrono::steady_clock::duration>(bufferDuration);
+		std::this_thread::sleep_until(deadline);
+
+		if (silentBuffers > 0)
+		{
+			std::fill_n(mBuffer.get(), mBufferSamples, 0.0f);
+			--silentBuffers;
+		}
+		else
+			Stream.Read(mBuffer.get(), mBufferSamples);
+		if (mWAVFile.is_open())
+			mWAVFile.write(reinterpret_cast<const char*>(mBuffer.get()), mBufferSamples * sizeof(float));
+		mPlayedSamples += mBufferSamples;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include "AudioStream.h"
+#include "SathwareException.h"
+#include "SathwareEngine.h"
+
+//Audio backend without a sound device, drains an AudioStream in real time like a sound card would
+//The samples are thrown away or appended to a 32 bit float WAV file, e.g. for headless runs or machines without XAudio2
+class SathwareAPI NullAudio
+{
+public:
+	//wavFile may be empty to discard the samples
+	NullAudio(AudioStream& stream, const std::filesystem::path& wavFile = {});
+	//Stops draining and finishes the WAV file
+	~NullAudio();
+
+	unsigned __int64 GetPlayedSamples() const
+	{
+		return mPlayedSamples;
+	}
+
+	NullAudio(const NullAudio& other) = delete;
+	NullAudio(const NullAudio&& other) = delete;
+	NullAudio& operator=(const NullAudio& other) = delete;
+private:
+	void PlaybackThread();
+
+	AudioStream& Stream;
+	//Same buffer size as Audio, a third of the stream's latency
+	size_t mBufferSamples;
+	std::unique_ptr<float[]> mBuffer;
+	//Playback thread only while it runs
+	std::ofstream mWAVFile;
+
+	std::thread mPlayback;
+	std::atomic<bool> mPlaying = true;
+	std::atomic<unsigned __int64> mPlayedSamples = 0;
+};
@@ -0,0 +1,248 @@
+#include "PostProcess.h"
+#include <emmintrin.h>
+#include <cstring>
+
+PostProcess::PostProcess(VideoSink& output, size_t width, size_t height, Filter filter, unsigned int scale)
+	: Output(output), mWidth(width), mHeight(height), mFilter(filter), mScale(scale)
+{
+	if (mFilter == Filter::Nearest && (mScale < 2u || mScale > 4u))
+		throw Exception(L"Nearest scaling supports 2x, 3x and 4x!");
+	if (mFilter == Filter::Scale2x && mScale != 2u && mScale != 4u)
+		throw Exception(L"Scale2x supports 2x and 4x!");
+	if (Output.GetWidth() != mWidth * mScale || Output.GetHeight() != mHeight * mScale)
+		throw Exception(L"Post process output has the wrong size!");
+
+	for (std::unique_ptr<Color[]>& frame : mInputFrames)
+		frame = std::make_unique<Color[]>(mWidth * mHeight);
+	if (mFilter == Filter::Scale2x && mScale == 4u)
+		mIntermediate = std::make_unique<Color[]>(mWidth * mHeight * 4u);
+}
+
+PostProcess::~PostProcess()
+{
+	StopWorker();
+}
+
+void PostProcess::PublishFrame()
+{
+	if (!mWorker.joinable())
+	{
+		Process(mInputFrames[mBackInput].get());
+		return;
+	}
+
+	//The worker is at most one frame behind, it almost always finished the last frame while this one was emulated
+	unsigned int pending = mPendingInput.load();
+	while (pending != noInput)
+	{
+		mPendingInput.wait(pending);
+		pending = mPendingInput.load();
+	}
+	mPendingInput = mBackInput;
+	mPendingInput.notify_all();
+	mBackInput ^= 1u;
+}
+
+void PostProcess::StartWorker()
+{
+	if (mWorker.joinable())
+		return;
+
+	mPendingInput = noInput;
+	mWorker = std::thread(&PostProcess::WorkerThread, this);
+}
+
+void PostProcess::StopWorker()
+{
+	if (!mWorker.joinable())
+		return;
+
+	//Let the worker finish the frame it has
+	unsigned int pending = mPendingInput.load();
+	while (pending != noInput)
+	{
+		mPendingInput.wait(pending);
+		pending = mPendingInput.load();
+	}
+	mPendingInput = stopWorker;
+	mPendingInput.notify_all();
+	mWorker.join();
+	mPendingInput = noInput;
+}
+
+void PostProcess::WorkerThread()
+{
+	while (true)
+	{
+		const unsigned int pending = mPendingInput.load();
+		if (pending == stopWorker)
+			return;
+		if (pending == noInput)
+		{
+			mPendingInput.wait(noInput);
+			continue;
+		}
+
+		Process(mInputFrames[pending].get());
+		mPendingInput = noInput;
+		mPendingInput.notify_all();
+	}
+}
+
+void PostProcess::Process(const Color* input)
+{
+	Color* output = Output.AcquireFrame();
+	if (mFilter == Filter::Nearest)
+		ScaleNearest(input, mWidth, mHeight, mScale, output);
+	else if (mScale == 2u)
+		Scale2x(input, mWidth, mHeight, output);
+	else
+	{
+		Scale2x(input, mWidth, mHeight, mIntermediate.get());
+		Scale2x(mIntermediate.get(), mWidth * 2u, mHeight * 2u, output);
+	}
+
+	if (mScanlines)
+		DarkenScanlines(output, mWidth * mScale, mHeight * mScale, mScale);
+	Output.PublishFrame();
+}
+
+void PostProcess::ScaleNearest(const Color* in, size_t width, size_t height, unsigned int scale, Color* out)
+{
+	const size_t outWidth = width * scale;
+	for (size_t y = 0; y < height; ++y)
+	{
+		const Color* inRow = &in[y * width];
+		Color* outRow = &out[y * scale * outWidth];
+
+		//Widen 4 pixels at a time by repeating each one scale times
+		size_t x = 0;
+		for (; x + 4u <= width; x += 4u)
+		{
+			const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&inRow[x]));
+			__m128i* dest = reinterpret_cast<__m128i*>(&outRow[x * scale]);
+			switch (scale)
+			{
+			case 2u:
+				_mm_storeu_si128(dest + 0, _mm_unpacklo_epi32(pixels, pixels));
+				_mm_storeu_si128(dest + 1, _mm_unpackhi_epi32(pixels, pixels));
+				break;
+			case 3u:
+				_mm_storeu_si128(dest + 0, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 0, 0, 0)));
+				_mm_storeu_si128(dest + 1, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 1, 1)));
+				_mm_storeu_si128(dest + 2, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 2)));
+				break;
+			case 4u:
+				_mm_storeu_si128(dest + 0, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(0, 0, 0, 0)));
+				_mm_storeu_si128(dest + 1, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(1, 1, 1, 1)));
+				_mm_storeu_si128(dest + 2, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(2, 2, 2, 2)));
+				_mm_storeu_si128(dest + 3, _mm_shuffle_epi32(pixels, _MM_SHUFFLE(3, 3, 3, 3)));
+				break;
+			}
+		}
+		for (; x < width; ++x)
+		{
+			for (unsigned int i = 0; i < scale; ++i)
+				outRow[x * scale + i] = inRow[x];
+		}
+
+		//The other rows of the block are copies of the first
+		for (unsigned int row = 1; row < scale; ++row)
+			memcpy(&outRow[row * outWidth], outRow, outWidth * sizeof(Color));
+	}
+}
+
+//Pick a when the condition lanes are all ones, b otherwise
+static __m128i Select(__m128i condition, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(condition, a), _mm_andnot_si128(condition, b));
+}
+
+//Scale2x for one pixel P with neighbours A (above), B (right), C (left) and D (below)
+//E0 E1 go to the top output row, E2 E3 to the bottom row
+static void Scale2xPixel(Color A, Color B, Color C, Color D, Color P, Color* top, Color* bottom)
+{
+	top[0] = (C.rgba == A.rgba && C.rgba != D.rgba && A.rgba != B.rgba) ? A : P;
+	top[1] = (A.rgba == B.rgba && A.rgba != C.rgba && B.rgba != D.rgba) ? B : P;
+	bottom[0] = (D.rgba == C.rgba && D.rgba != B.rgba && C.rgba != A.rgba) ? C : P;
+	bottom[1] = (B.rgba == D.rgba && B.rgba != A.rgba && D.rgba != C.rgba) ? D : P;
+}
+
+void PostProcess::Scale2x(const Color* in, size_t width, size_t height, Color* out)
+{
+	const size_t outWidth = width * 2u;
+	for (size_t y = 0; y < height; ++y)
+	{
+		//Pixels past the edges repeat the edge pixel
+		const Color* above = &in[(y > 0 ? y - 1u : y) * width];
+		const Color* row = &in[y * width];
+		const Color* below = &in[(y + 1u < height ? y + 1u : y) * width];
+		Color* top = &out[y * 2u * outWidth];
+		Color* bottom = top + outWidth;
+
+		auto scalarPixel = [&](size_t x)
+		{
+			const Color left = row[x > 0 ? x - 1u : x];
+			const Color right = row[x + 1u < width ? x + 1u : x];
+			Scale2xPixel(above[x], right, left, below[x], row[x], &top[x * 2u], &bottom[x * 2u]);
+		};
+
+		scalarPixel(0);
+		//4 pixels at a time, left and right neighbours are the same row loaded one pixel off
+		size_t x = 1u;
+		for (; x + 5u <= width; x += 4u)
+		{
+			const __m128i A = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&above[x]));
+			const __m128i B = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[x + 1u]));
+			const __m128i C = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[x - 1u]));
+			const __m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&below[x]));
+			const __m128i P = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[x]));
+
+			const __m128i AeqB = _mm_cmpeq_epi32(A, B);
+			const __m128i AeqC = _mm_cmpeq_epi32(A, C);
+			const __m128i BeqD = _mm_cmpeq_epi32(B, D);
+			const __m128i CeqD = _mm_cmpeq_epi32(C, D);
+
+			//andnot(x, y) = ~x & y, so each of these is (first equal) && (other two not equal)
+			const __m128i E0 = Select(_mm_andnot_si128(_mm_or_si128(CeqD, AeqB), AeqC), A, P);
+			const __m128i E1 = Select(_mm_andnot_si128(_mm_or_si128(AeqC, BeqD), AeqB), B, P);
+			const __m128i E2 = Select(_mm_andnot_si128(_mm_or_si128(BeqD, AeqC), CeqD), C, P);
+			const __m128i E3 = Select(_mm_andnot_si128(_mm_or_si128(AeqB, CeqD), BeqD), D, P);
+
+			__m128i* topDest = reinterpret_cast<__m128i*>(&top[x * 2u]);
+			__m128i* bottomDest = reinterpret_cast<__m128i*>(&bottom[x * 2u]);
+			_mm_storeu_si128(topDest + 0, _mm_unpacklo_epi32(E0, E1));
+			_mm_storeu_si128(topDest + 1, _mm_unpackhi_epi32(E0, E1));
+			_mm_storeu_si128(bottomDest + 0, _mm_unpacklo_epi32(E2, E3));
+			_mm_storeu_si128(bottomDest + 1, _mm_unpackhi_epi32(E2, E3));
+		}
+		for (; x < width; ++x)
+			scalarPixel(x);
+	}
+}
+
+void PostProcess::DarkenScanlines(Color* image, size_t width, size_t height, unsigned int scale)
+{
+	//c / 2 + c / 4 on every byte, with the shifted in bits masked off so they don't leak into the next channel
+	const __m128i halfMask = _mm_set1_epi8(0x7f);
+	const __m128i quarterMask = _mm_set1_epi8(0x3f);
+	const __m128i alphaMask = _mm_set1_epi32((int)0xff000000);
+	for (size_t y = scale - 1u; y < height; y += scale)
+	{
+		Color* row = &image[y * width];
+		size_t x = 0;
+		for (; x + 4u <= width; x += 4u)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&row[x]));
+			const __m128i alpha = _mm_and_si128(pixels, alphaMask);
+			pixels = _mm_add_epi8(_mm_and_si128(_mm_srli_epi32(pixels, 1), halfMask), _mm_and_si128(_mm_srli_epi32(pixels, 2), quarterMask));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(&row[x]), _mm_or_si128(_mm_andnot_si128(alphaMask, pixels), alpha));
+		}
+		for (; x < width; ++x)
+		{
+			const unsigned __int32 pixel = row[x].rgba;
+			const unsigned __int32 darkened = ((pixel >> 1u) & 0x7f7f7f7fu) + ((pixel >> 2u) & 0x3f3f3f3fu);
+			row[x].rgba = (darkened & 0x00ffffffu) | (pixel & 0xff000000u);
+		}
+	}
+}
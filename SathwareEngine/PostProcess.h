@@ -0,0 +1,82 @@
+#pragma once
+#include <memory>
+#include <atomic>
+#include <thread>
+#include "VideoSink.h"
+#include "SathwareException.h"
+#include "SathwareEngine.h"
+
+//Software scaling and filtering in front of another video sink, so upscaling doesn't depend on a GPU backend
+//Frames are drawn at the source size, filtered, and published to the output at scale times the size
+//With a worker thread the filter for one frame runs while the producer emulates the next one
+class SathwareAPI PostProcess : public VideoSink
+{
+public:
+	enum class Filter
+	{
+		//Every pixel becomes a scale x scale block, scale 2, 3 or 4
+		Nearest,
+		//Edge smoothing, Source: "https://www.scale2x.it/algorithm", scale 2, or 4 by running it twice
+		Scale2x
+	};
+
+	//output has to be width * scale by height * scale, it is only used from the worker thread while the worker runs
+	PostProcess(VideoSink& output, size_t width, size_t height, Filter filter, unsigned int scale);
+	~PostProcess() override;
+
+	size_t GetWidth() const override
+	{
+		return mWidth;
+	}
+	size_t GetHeight() const override
+	{
+		return mHeight;
+	}
+	Color* AcquireFrame() override
+	{
+		return mInputFrames[mBackInput].get();
+	}
+	//Filters the frame and publishes it to the output, or hands it to the worker thread if it is running
+	void PublishFrame() override;
+
+	//Darken the last output row of every source row
+	void SetScanlines(bool enabled)
+	{
+		mScanlines = enabled;
+	}
+	void StartWorker();
+	void StopWorker();
+
+	/* Filters, all of them take width * height input and write (width * scale) * (height * scale) output */
+	static void ScaleNearest(const Color* in, size_t width, size_t height, unsigned int scale, Color* out);
+	static void Scale2x(const Color* in, size_t width, size_t height, Color* out);
+	//Bring every row of image at (row % scale == scale - 1) down to 75% brightness, alpha is kept
+	static void DarkenScanlines(Color* image, size_t width, size_t height, unsigned int scale);
+
+	PostProcess(const PostProcess& other) = delete;
+	PostProcess(const PostProcess&& other) = delete;
+	PostProcess& operator=(const PostProcess& other) = delete;
+private:
+	//Filter one input frame into the output sink and publish it
+	void Process(const Color* input);
+	void WorkerThread();
+
+	VideoSink& Output;
+	size_t mWidth;
+	size_t mHeight;
+	Filter mFilter;
+	unsigned int mScale;
+	std::atomic<bool> mScanlines = false;
+
+	//Double buffered, the producer draws into the back input while the worker filters the other one
+	std::unique_ptr<Color[]> mInputFrames[2];
+	unsigned int mBackInput = 0;
+	//Scale2x result for the second pass of 4x
+	std::unique_ptr<Color[]> mIntermediate;
+
+	std::thread mWorker;
+	//Index of the input frame the worker has to filter, or one of the values below
+	static constexpr unsigned int noInput = 2u;
+	static constexpr unsigned int stopWorker = 3u;
+	std::atomic<unsigned int> mPendingInput = noInput;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <array>
+#include <cstddef>
+
+//Lock free single producer single consumer ring buffer
+//Push may only be called from one thread and Pop from one other thread, Capacity must be a power of two
+template <typename T, size_t Capacity>
+class SPSCQueue
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+public:
+	//Returns false if the queue is full
+	bool Push(const T& item)
+	{
+		const size_t tail = mTail.load(std::memory_order_relaxed);
+		if (tail - mHead.load(std::memory_order_acquire) == Capacity)
+			return false;
+
+		mItems[tail % Capacity] = item;
+		//Release so the consumer sees the item before it sees the new tail
+		mTail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Returns false if the queue is empty
+	bool Pop(T& item)
+	{
+		const size_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire))
+			return false;
+
+		item = mItems[head % Capacity];
+		//Release so the producer only reuses the slot after the item was read
+		mHead.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Number of queued items, only exact when called from the producer or consumer thread
+	size_t Size() const
+	{
+		return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+	}
+private:
+	std::array<T, Capacity> mItems{};
+	//Head and tail are written by different threads, keep them on separate cache lines
+	alignas(64) std::atomic<size_t> mHead = 0;
+	alignas(64) std::atomic<size_t> mTail = 0;
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include "Color.h"
+#include "SathwareEngine.h"
+
+//Anything that accepts finished frames from an emulator, e.g. the Direct3D Graphics backend or HeadlessVideo
+//All functions are called from the producer (emulation or render) thread
+class SathwareAPI VideoSink
+{
+public:
+	virtual ~VideoSink() = default;
+
+	virtual size_t GetWidth() const = 0;
+	virtual size_t GetHeight() const = 0;
+	//The GetWidth() * GetHeight() frame to draw the next frame into, stays the same until PublishFrame
+	virtual Color* AcquireFrame() = 0;
+	//Optional GetWidth() * GetHeight() buffer of palette indexes for producers that have them, nullptr if the sink doesn't use them
+	//When not nullptr it has to be filled along with AcquireFrame before every PublishFrame
+	virtual unsigned __int8* AcquireIndexedFrame()
+	{
+		return nullptr;
+	}
+	//Hand the acquired frame over to the sink
+	virtual void PublishFrame() = 0;
+
+	//FNV-1a over the pixels of a row, lets sinks find rows that didn't change since the last frame, Source: "http://www.isthe.com/chongo/tech/comp/fnv/"
+	static unsigned __int64 HashRow(const Color* row, size_t width)
+	{
+		unsigned __int64 hash = 0xcbf29ce484222325u;
+		for (size_t x = 0; x < width; ++x)
+			hash = (hash ^ row[x].rgba) * 0x100000001b3u;
+		return hash;
+	}
+};